@@ -0,0 +1,48 @@
+// arrays.cpp
+//
+// Benchmark for bulk array reads.
+// Compares the iterator interface against reads into std::vector and raw buffers. Times are given
+// per element, with size the number of elements read.
+
+#include <luaconfig/luaconfig.hpp>
+#include "bench.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+int main(void)
+{
+    luaconfig::Config cfg("bench.lua");
+
+    bench::report_header();
+    for( std::size_t n : {1000, 10000, 100000, 1000000}){
+        std::size_t reps = 10000000/n;
+        std::vector<double> v(n);
+        std::vector<float> f(n);
+        std::vector<std::int32_t> i32(n);
+        double t_it = bench::ns_per_op( reps, [&](){
+            cfg.get("numbers",v.begin(),v.end());
+            bench::do_not_optimize(v[n-1]);
+        });
+        double t_vec = bench::ns_per_op( 10, [&](){
+            auto w = cfg.get<std::vector<double>>("numbers");
+            bench::do_not_optimize(w[n-1]);
+        });
+        double t_float = bench::ns_per_op( reps, [&](){
+            cfg.get("numbers",f.data(),n);
+            bench::do_not_optimize(f[n-1]);
+        });
+        double t_int = bench::ns_per_op( reps, [&](){
+            cfg.get("integers",i32.data(),n);
+            bench::do_not_optimize(i32[n-1]);
+        });
+        // get<std::vector> always reads the whole array
+        double n_total = static_cast<double>(cfg.len("numbers"));
+        bench::report("array/iterator",n,t_it/n);
+        bench::report("array/vector",n,t_vec/n_total);
+        bench::report("array/float",n,t_float/n);
+        bench::report("array/int32",n,t_int/n);
+    }
+
+    return EXIT_SUCCESS;
+}
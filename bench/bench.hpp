@@ -0,0 +1,41 @@
+// bench.hpp
+//
+// Minimal timing utilities shared by the luaconfig benchmarks.
+
+#ifndef __LUACONFIG_BENCH_HPP
+#define __LUACONFIG_BENCH_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+namespace bench {
+
+// Prevent the compiler from optimising away a result
+template<class T>
+inline void do_not_optimize( const T& value){
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Run f() n times, return mean time per call in nanoseconds
+template<class F>
+double ns_per_op( std::size_t n, F f){
+    auto start = std::chrono::steady_clock::now();
+    for( std::size_t i=0; i<n; ++i) f();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double,std::nano>(stop-start).count() / n;
+}
+
+// Write one result as a tab-separated line: benchmark name, problem size, mean ns per operation
+// All results from the suite share this format, so runs may be compared with standard tools.
+inline void report( const std::string& name, std::size_t size, double ns){
+    std::printf("%s\t%zu\t%.2f\n",name.c_str(),size,ns);
+}
+
+inline void report_header(){
+    std::printf("benchmark\tsize\tns_per_op\n");
+}
+
+} // end namespace
+#endif
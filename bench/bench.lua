@@ -0,0 +1,23 @@
+-- Lua configuration file used for benchmarking purposes
+
+x = 700
+s = "I am a string"
+
+color = { r=0.5, g=0.7, b=0 }
+
+table = {
+    float = 0.2,
+    int = 5,
+    string = "hello there",
+    table = {
+        string = "nested",
+    },
+}
+
+-- Large arrays, generated on load
+numbers = {}
+integers = {}
+for i=1,1000000 do
+    numbers[i] = i*0.5
+    integers[i] = i
+end
@@ -0,0 +1,208 @@
+// core.cpp
+//
+// Benchmark suite covering the core operations of Config, Setting and Function.
+// Each configuration is generated in memory, padded with a number of unrelated globals so that
+// lookups may be compared across config sizes. Results are written in the tab-separated format of
+// bench::report, one line per benchmark and size.
+
+#include <luaconfig/luaconfig.hpp>
+#include "bench.hpp"
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using luaconfig::Config;
+using luaconfig::Function;
+using luaconfig::Path;
+using luaconfig::Setting;
+
+static const std::size_t n_ops = 1000000;
+
+// Config with n_globals padding tables, a nest of tables 8 deep, and functions of 0-8 arguments
+Config generate( std::size_t n_globals){
+    std::string src =
+        "for i=1," + std::to_string(n_globals) + " do _G['g'..i] = { value = i } end\n"
+        "number = 1.5\n"
+        "integer = 42\n"
+        "boolean = true\n"
+        "string = 'hello there'\n"
+        "array = { 1, 2, 3, 4, 5, 6, 7, 8 }\n"
+        "leaf = 0\n"
+        "nest = {}\n"
+        "local t = nest\n"
+        "for i=1,8 do t.leaf = i; t.a = {}; t = t.a end\n"
+        "function f0() return 0 end\n"
+        "function f1(a) return a end\n"
+        "function f2(a,b) return a+b end\n"
+        "function f3(a,b,c) return a+b+c end\n"
+        "function f4(a,b,c,d) return a+b+c+d end\n"
+        "function f5(a,b,c,d,e) return a+b+c+d+e end\n"
+        "function f6(a,b,c,d,e,f) return a+b+c+d+e+f end\n"
+        "function f7(a,b,c,d,e,f,g) return a+b+c+d+e+f+g end\n"
+        "function f8(a,b,c,d,e,f,g,h) return a+b+c+d+e+f+g+h end\n"
+        "function triple(a) return a, a+1, a+2 end\n";
+    return Config::from_buffer(src,"bench");
+}
+
+// Key reaching depth d, where 1 <= d <= 8
+std::string depth_key( int d){
+    if( d == 1 ) return "leaf";
+    std::string key = "nest";
+    for( int i=2; i<d; ++i) key += ".a";
+    return key + ".leaf";
+}
+
+void bench_get( Config& cfg, std::size_t size){
+    bench::report("get/double",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(cfg.get<double>("number")); }));
+    bench::report("get/int",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(cfg.get<int>("integer")); }));
+    bench::report("get/bool",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(cfg.get<bool>("boolean")); }));
+    bench::report("get/string",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(cfg.get<std::string>("string")); }));
+    bench::report("get/default",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(cfg.get<double>("missing",0.0)); }));
+}
+
+// Each lookup is repeated with the key cache disabled, to show the saving from interned keys
+void bench_depth( Config& cfg, std::size_t size){
+    for( int d=1; d<=8; ++d){
+        std::string key = depth_key(d);
+        Path path(key);
+        std::string suffix = "/depth" + std::to_string(d);
+        bench::report("path/string"+suffix,size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(cfg.get<int>(key.c_str())); }));
+        bench::report("path/Path"+suffix,size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(cfg.get<int>(path)); }));
+        cfg.set_key_cache_limit(0);
+        bench::report("path/string_uncached"+suffix,size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(cfg.get<int>(key.c_str())); }));
+        bench::report("path/Path_uncached"+suffix,size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(cfg.get<int>(path)); }));
+        cfg.set_key_cache_limit(luaconfig::KeyCache::default_limit);
+    }
+}
+
+// Four keys sharing the prefix "nest.a.a", read separately and as one batch
+void bench_many( Config& cfg, std::size_t size){
+    std::string k5 = depth_key(5), k6 = depth_key(6), k7 = depth_key(7), k8 = depth_key(8);
+    std::vector<std::string> keys = {k5,k6,k7,k8};
+    bench::report("many/separate",size,bench::ns_per_op(n_ops,[&](){
+        bench::do_not_optimize(cfg.get<int>(k5.c_str()));
+        bench::do_not_optimize(cfg.get<int>(k6.c_str()));
+        bench::do_not_optimize(cfg.get<int>(k7.c_str()));
+        bench::do_not_optimize(cfg.get<int>(k8.c_str()));
+    }));
+    bench::report("many/tuple",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(cfg.get_many<int,int,int,int>(k5,k6,k7,k8)); }));
+    bench::report("many/vector",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(cfg.get_many<int>(keys)); }));
+}
+
+void bench_exists_len( Config& cfg, std::size_t size){
+    bench::report("exists/present",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(cfg.exists("number")); }));
+    bench::report("exists/missing",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(cfg.exists("missing")); }));
+    bench::report("exists/nested",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(cfg.exists("nest.a.a.leaf")); }));
+    bench::report("len",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(cfg.len("array")); }));
+}
+
+void bench_setting( Config& cfg, std::size_t size){
+    bench::report("setting/create",size,bench::ns_per_op(n_ops,[&](){
+        auto s = cfg.get<Setting>("nest");
+        bench::do_not_optimize(s);
+    }));
+    auto s = cfg.get<Setting>("nest");
+    bench::report("setting/refocus",size,bench::ns_per_op(n_ops,[&](){ cfg.refocus(s,"nest"); }));
+    bench::report("setting/copy",size,bench::ns_per_op(n_ops,[&](){
+        Setting copy(s);
+        bench::do_not_optimize(copy);
+    }));
+    Setting other = cfg.get<Setting>("nest.a");
+    bench::report("setting/move",size,bench::ns_per_op(n_ops,[&](){
+        Setting moved(std::move(s));
+        s = std::move(moved);
+        bench::do_not_optimize(s);
+    }));
+    bench::report("setting/get",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(other.get<int>("leaf")); }));
+}
+
+void bench_functions( Config& cfg, std::size_t size){
+    auto f0 = cfg.get<Function<double()>>("f0");
+    auto f1 = cfg.get<Function<double(double)>>("f1");
+    auto f2 = cfg.get<Function<double(double,double)>>("f2");
+    auto f3 = cfg.get<Function<double(double,double,double)>>("f3");
+    auto f4 = cfg.get<Function<double(double,double,double,double)>>("f4");
+    auto f5 = cfg.get<Function<double(double,double,double,double,double)>>("f5");
+    auto f6 = cfg.get<Function<double(double,double,double,double,double,double)>>("f6");
+    auto f7 = cfg.get<Function<double(double,double,double,double,double,double,double)>>("f7");
+    auto f8 = cfg.get<Function<double(double,double,double,double,double,double,double,double)>>("f8");
+    bench::report("function/args0",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(f0()); }));
+    bench::report("function/args1",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(f1(1)); }));
+    bench::report("function/args2",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(f2(1,2)); }));
+    bench::report("function/args3",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(f3(1,2,3)); }));
+    bench::report("function/args4",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(f4(1,2,3,4)); }));
+    bench::report("function/args5",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(f5(1,2,3,4,5)); }));
+    bench::report("function/args6",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(f6(1,2,3,4,5,6)); }));
+    bench::report("function/args7",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(f7(1,2,3,4,5,6,7)); }));
+    bench::report("function/args8",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(f8(1,2,3,4,5,6,7,8)); }));
+    auto triple = cfg.get<Function<std::tuple<double,double,double>(double)>>("triple");
+    bench::report("function/tuple3",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(triple(1)); }));
+    auto wrapped = cfg.get<std::function<double(double)>>("f1");
+    bench::report("function/std_function",size,bench::ns_per_op(n_ops,[&](){ bench::do_not_optimize(wrapped(1)); }));
+    bench::report("function/create",size,bench::ns_per_op(n_ops,[&](){
+        auto f = cfg.get<Function<double(double)>>("f1");
+        bench::do_not_optimize(f);
+    }));
+    bench::report("function/create_std_function",size,bench::ns_per_op(n_ops,[&](){
+        auto f = cfg.get<std::function<double(double)>>("f1");
+        bench::do_not_optimize(f);
+    }));
+}
+
+void bench_arrays(){
+    for( std::size_t n : {1000, 10000, 100000, 1000000}){
+        std::string src = "numbers = {} for i=1," + std::to_string(n) + " do numbers[i] = i*0.5 end";
+        auto cfg = Config::from_buffer(src,"bench_arrays");
+        std::size_t reps = 10000000/n;
+        std::vector<double> v(n);
+        bench::report("array/iterator",n,bench::ns_per_op(reps,[&](){
+            cfg.get("numbers",v.begin(),v.end());
+            bench::do_not_optimize(v.data());
+        }) / n);
+        bench::report("array/buffer",n,bench::ns_per_op(reps,[&](){
+            cfg.get("numbers",v.data(),n);
+            bench::do_not_optimize(v.data());
+        }) / n);
+        bench::report("array/vector",n,bench::ns_per_op(reps,[&](){
+            auto r = cfg.get<std::vector<double>>("numbers");
+            bench::do_not_optimize(r.data());
+        }) / n);
+        auto numbers = cfg.get<Setting>("numbers");
+        bench::report("array/pairs",n,bench::ns_per_op(reps,[&](){
+            double sum = 0;
+            for( auto&& entry : numbers.pairs()) sum += entry.as<double>();
+            bench::do_not_optimize(sum);
+        }) / n);
+        bench::report("array/ipairs",n,bench::ns_per_op(reps,[&](){
+            double sum = 0;
+            for( auto&& entry : numbers.ipairs()) sum += entry.as<double>();
+            bench::do_not_optimize(sum);
+        }) / n);
+        std::string src_out;
+        bench::report("array/dump",n,bench::ns_per_op(reps,[&](){
+            src_out.clear();
+            numbers.dump(src_out);
+            bench::do_not_optimize(src_out.data());
+        }) / n);
+    }
+}
+
+int main(void)
+{
+    bench::report_header();
+    for( std::size_t size : {10, 1000, 100000}){
+        auto cfg = generate(size);
+        bench_get(cfg,size);
+        bench_depth(cfg,size);
+        bench_many(cfg,size);
+        bench_exists_len(cfg,size);
+        bench_setting(cfg,size);
+        bench_functions(cfg,size);
+    }
+    // Array results are per element
+    bench_arrays();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,63 @@
+// functions.cpp
+//
+// Benchmark for the Function call path.
+// Measures per-call overhead for scalar and string signatures, and for strings passed as
+// std::string and as const char*, and compares calls in a C++ loop against Function::map.
+
+#include <luaconfig/luaconfig.hpp>
+#include "bench.hpp"
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using luaconfig::Function;
+
+int main(void)
+{
+    auto cfg = luaconfig::Config::from_buffer(
+        "function scalar(a) return a end\n"
+        "function scalar2(a,b) return a+b end\n"
+        "function str(s) return s end\n"
+        "function concat(a,b) return a..b end\n"
+        "function strlen(s) return #s end\n","bench_functions");
+
+    const std::size_t n = 1000000;
+    std::string short_str("short");
+    std::string long_str(1024,'x');
+
+    auto scalar = cfg.get<Function<double(double)>>("scalar");
+    auto scalar2 = cfg.get<Function<double(double,double)>>("scalar2");
+    auto str = cfg.get<Function<std::string(std::string)>>("str");
+    auto concat = cfg.get<Function<std::string(std::string,std::string)>>("concat");
+    auto strlen_s = cfg.get<Function<int(std::string)>>("strlen");
+    auto strlen_c = cfg.get<Function<int(const char*)>>("strlen");
+
+    bench::report_header();
+    bench::report("call/scalar",1,bench::ns_per_op(n,[&](){ bench::do_not_optimize(scalar(1.0)); }));
+    bench::report("call/scalar",2,bench::ns_per_op(n,[&](){ bench::do_not_optimize(scalar2(1.0,2.0)); }));
+    bench::report("call/string_in_out",short_str.size(),bench::ns_per_op(n,[&](){ bench::do_not_optimize(str(short_str)); }));
+    bench::report("call/string_in_out",long_str.size(),bench::ns_per_op(n,[&](){ bench::do_not_optimize(str(long_str)); }));
+    bench::report("call/concat",short_str.size(),bench::ns_per_op(n,[&](){ bench::do_not_optimize(concat(short_str,short_str)); }));
+    bench::report("call/string_in",long_str.size(),bench::ns_per_op(n,[&](){ bench::do_not_optimize(strlen_s(long_str)); }));
+    bench::report("call/const_char_in",long_str.size(),bench::ns_per_op(n,[&](){ bench::do_not_optimize(strlen_c(long_str.c_str())); }));
+
+    // Batched calls, per element
+    for( std::size_t size : {1000, 1000000}){
+        std::vector<double> x(size,1.0), y(size), z(size);
+        std::size_t reps = 10000000/size;
+        bench::report("loop/scalar",size,bench::ns_per_op(reps,[&](){
+            for( std::size_t i=0; i<size; ++i) y[i] = scalar(x[i]);
+            bench::do_not_optimize(y.data());
+        }) / size);
+        bench::report("map/scalar",size,bench::ns_per_op(reps,[&](){
+            scalar.map(x.begin(),x.end(),y.begin());
+            bench::do_not_optimize(y.data());
+        }) / size);
+        bench::report("map/scalar2",size,bench::ns_per_op(reps,[&](){
+            scalar2.map(x.begin(),x.end(),z.begin(),y.begin());
+            bench::do_not_optimize(z.data());
+        }) / size);
+    }
+
+    return EXIT_SUCCESS;
+}
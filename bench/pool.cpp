@@ -0,0 +1,39 @@
+// pool.cpp
+//
+// Benchmark for FunctionPool.
+// Measures throughput of parallel_map against the number of workers, for a function that does a
+// moderate amount of arithmetic per element.
+
+#include <luaconfig/luaconfig.hpp>
+#include "bench.hpp"
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+int main(void)
+{
+    auto make_config = []{
+        return luaconfig::Config::from_buffer(
+            "function transfer(x)\n"
+            "    local y = 0\n"
+            "    for k=1,20 do y = y + math.sin(x*k)/k end\n"
+            "    return y\n"
+            "end\n","bench_pool");
+    };
+
+    const std::size_t n = 1000000;
+    std::vector<double> x(n), y(n);
+    for( std::size_t i=0; i<n; ++i) x[i] = i*1e-3;
+
+    bench::report_header();
+    std::size_t max_workers = std::max(1u,std::thread::hardware_concurrency());
+    for( std::size_t workers=1; workers<=max_workers; workers*=2){
+        luaconfig::FunctionPool<double(double)> pool(make_config,"transfer",workers);
+        bench::report("parallel_map/workers",workers,bench::ns_per_op(1,[&](){
+            pool.parallel_map(x.begin(),x.end(),y.begin());
+            bench::do_not_optimize(y.data());
+        }) / n);
+    }
+
+    return EXIT_SUCCESS;
+}
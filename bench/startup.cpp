@@ -0,0 +1,51 @@
+// startup.cpp
+//
+// Benchmark for Config startup.
+// Generates a large configuration file, then compares loading it from source against loading it
+// through a BytecodeCache. Times are given per load, with size the number of bytes of source.
+
+#include <luaconfig/luaconfig.hpp>
+#include "bench.hpp"
+#include <cstdio>
+#include <cstdlib>
+
+// Write config with n generated tables, return size in bytes
+long generate( const char* filename, int n){
+    FILE* f = std::fopen(filename,"w");
+    std::fprintf(f,"servers = {\n");
+    for( int i=1; i<=n; ++i){
+        std::fprintf(f,"    { name = \"server%d\", port = %d, weight = %f, tags = { \"a\", \"b\", \"c\" }, limits = { cpu = %d, mem = %d } },\n",
+            i, 8000+i, i*0.25, i%64, i*1024);
+    }
+    std::fprintf(f,"}\n");
+    long size = std::ftell(f);
+    std::fclose(f);
+    return size;
+}
+
+int main(void)
+{
+    const char* filename = "bench_startup.lua";
+    luaconfig::BytecodeCache cache;
+
+    bench::report_header();
+    for( int n : {10000, 50000, 100000}){
+        long size = generate(filename,n);
+        std::remove(cache.cache_path(filename).c_str());
+        double t_text = bench::ns_per_op( 5, [&](){
+            luaconfig::Config cfg(filename);
+            bench::do_not_optimize(cfg);
+        });
+        { luaconfig::Config warm(filename,cache); } // write cache
+        double t_cached = bench::ns_per_op( 5, [&](){
+            luaconfig::Config cfg(filename,cache);
+            bench::do_not_optimize(cfg);
+        });
+        bench::report("startup/text",size,t_text);
+        bench::report("startup/cached",size,t_cached);
+    }
+    std::remove(filename);
+    std::remove(cache.cache_path(filename).c_str());
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,34 @@
+// threads.cpp
+//
+// Benchmark for the thread pool in threads.hpp, as used by Generator.
+// Measures the cost of acquiring and releasing a thread while a growing number of other threads
+// are held alive, with size the number of live threads. This should remain flat in size.
+
+#include <luaconfig/luaconfig.hpp>
+#include "bench.hpp"
+#include <cstdlib>
+#include <vector>
+
+int main(void)
+{
+    lua_State* L = luaL_newstate();
+
+    bench::report_header();
+    for( std::size_t n_live : {0, 1000, 10000, 100000}){
+        // Hold n_live threads
+        std::vector<int> live;
+        live.reserve(n_live);
+        for( std::size_t i=0; i<n_live; ++i) live.push_back(luaconfig::new_thread(L).second);
+        // Time acquisition and release of one more
+        double t = bench::ns_per_op( 100000, [&](){
+            auto thread = luaconfig::new_thread(L);
+            bench::do_not_optimize(thread.first);
+            luaconfig::kill_thread(L,thread.second);
+        });
+        bench::report("thread/new_kill",n_live,t);
+        for( auto id : live) luaconfig::kill_thread(L,id);
+    }
+
+    lua_close(L);
+    return EXIT_SUCCESS;
+}
@@ -1,5 +1,15 @@
 // Include file for Luaconfig
+#include "src/allocators.hpp"
 #include "src/core.hpp"
+#include "src/Path.hpp"
+#include "src/batch.hpp"
 #include "src/Config.hpp"
 #include "src/Setting.hpp"
 #include "src/Function.hpp"
+#include "src/Snapshot.hpp"
+#include "src/FunctionPool.hpp"
+#include "src/Generator.hpp"
+#include "src/binding.hpp"
+#include "src/ReloadingConfig.hpp"
+#include "src/LayeredConfig.hpp"
+#include "src/serialize.hpp"
@@ -13,12 +13,19 @@ extern "C" {
 #include <lualib.h>
 }
 
+#include <memory>
 #include <string>
 #include <type_traits>
 #include <utility>
 #include <tuple>
+#include <vector>
 
+#include "allocators.hpp"
+#include "batch.hpp"
 #include "core.hpp"
+#include "load.hpp"
+#include "serialize.hpp"
+#include "Snapshot.hpp"
 #include "utils.hpp"
 #include "Setting.hpp"
 
@@ -28,26 +35,119 @@ class Config
 {
     private:
 
+    std::unique_ptr<Allocator> _alloc; // Declared first, so it is available to create _L
     lua_State* _L;
     std::string _filename;
+    std::unique_ptr<Stats> _stats;     // Only created if LUACONFIG_INSTRUMENT is defined
+    std::unique_ptr<KeyCache> _keys;
 
     using Scope = Global;
 
+    friend class LayeredConfig;
+
+    // Open standard libraries and start counting garbage collection cycles
+    // Run within a protected call, so that running out of memory can be caught.
+    static int open_libs( lua_State* L){
+        Allocator* alloc = static_cast<Allocator*>(lua_touserdata(L,1));
+        luaL_openlibs(L);
+        alloc->arm_gc_sentinel(L);
+        return 0;
+    }
+
+    // Create new Lua State without loading anything
+    // Constructors that load a file delegate to this one, so that the destructor closes the Lua
+    // State if loading throws.
+    struct NoLoad {};
+
+    Config( const char* name, NoLoad, std::unique_ptr<Allocator> alloc = nullptr) :
+        _alloc(alloc ? std::move(alloc) : std::unique_ptr<Allocator>(new MallocAllocator)),
+        _L(new_state(*_alloc)),
+        _filename(name)
+    {
+        if( _L == nullptr ) throw MemoryException("cannot create Lua state: not enough memory");
+        lua_pushcfunction(_L,&open_libs);
+        lua_pushlightuserdata(_L,_alloc.get());
+        if( lua_pcall(_L,1,0,0) != LUA_OK ){
+            std::string msg = lua_tostring(_L,-1) ? lua_tostring(_L,-1) : "unknown error";
+            lua_close(_L);
+            throw MemoryException(msg.c_str());
+        }
+#ifdef LUACONFIG_INSTRUMENT
+        _stats.reset(new Stats);
+        register_stats(_L,_stats.get());
+#endif
+        _keys.reset(new KeyCache);
+        KeyCache::of(_L) = _keys.get();
+    }
+
     public:
 
     // ====================================================
     // Constructor and Destructor
 
-    Config( const char* filename ) :
-        _L(luaL_newstate()),
-        _filename(filename)
-    {
-        luaL_openlibs(_L);   
-        if ( luaL_loadfile(_L,filename) || lua_pcall(_L, 0, 0, 0) ) throw FileException(lua_tostring(_L,-1));
+    Config( const char* filename ) : Config(filename,NoLoad()) {
+        load_file(_L,filename);
     }
 
     Config( const std::string& filename) : Config(filename.c_str()) {}
 
+    // Load via bytecode cache
+    Config( const char* filename, const BytecodeCache& cache) : Config(filename,NoLoad()) {
+        cache.load(_L,filename);
+    }
+
+    Config( const std::string& filename, const BytecodeCache& cache) : Config(filename.c_str(),cache) {}
+
+    // Allocate all memory through the given allocator, which the Config takes ownership of
+    Config( const char* filename, std::unique_ptr<Allocator> alloc) : Config(filename,NoLoad(),std::move(alloc)) {
+        load_file(_L,filename);
+    }
+
+    Config( const std::string& filename, std::unique_ptr<Allocator> alloc) : Config(filename.c_str(),std::move(alloc)) {}
+
+    Config( const char* filename, const BytecodeCache& cache, std::unique_ptr<Allocator> alloc) :
+        Config(filename,NoLoad(),std::move(alloc))
+    {
+        cache.load(_L,filename);
+    }
+
+    Config( const std::string& filename, const BytecodeCache& cache, std::unique_ptr<Allocator> alloc) :
+        Config(filename.c_str(),cache,std::move(alloc)) {}
+
+    // ====================================================
+    // Factories for other sources
+
+    // Each optionally takes an allocator, as above.
+
+    // Load from memory-mapped file
+    static Config from_mmap( const char* filename, std::unique_ptr<Allocator> alloc = nullptr){
+        Config cfg(filename,NoLoad(),std::move(alloc));
+        load_mmap(cfg._L,filename);
+        return cfg;
+    }
+
+    static Config from_mmap( const std::string& filename, std::unique_ptr<Allocator> alloc = nullptr){
+        return from_mmap(filename.c_str(),std::move(alloc));
+    }
+
+    // Load from buffer in memory. The name is used in error messages.
+    static Config from_buffer( const char* data, std::size_t size, const char* name = "buffer", std::unique_ptr<Allocator> alloc = nullptr){
+        Config cfg(name,NoLoad(),std::move(alloc));
+        load_buffer(cfg._L,data,size,(std::string("=") + name).c_str());
+        return cfg;
+    }
+
+    static Config from_buffer( const std::string& data, const char* name = "buffer", std::unique_ptr<Allocator> alloc = nullptr){
+        return from_buffer(data.data(),data.size(),name,std::move(alloc));
+    }
+
+    // Load from file descriptor, read until end of file. The descriptor is not closed.
+    static Config from_fd( int fd, const char* name = "fd", std::unique_ptr<Allocator> alloc = nullptr){
+        Config cfg(name,NoLoad(),std::move(alloc));
+        load_fd(cfg._L,fd,(std::string("=") + name).c_str());
+        return cfg;
+    }
+
     ~Config(){
         if ( _L != nullptr ) lua_close(_L);
     }
@@ -61,19 +161,25 @@ class Config
 
     // ====================================================
     // Move constructor / move assignment
-    // Both will invalidate the original Config object
+    // Both will invalidate the original Config object. On assignment, the previous Lua State is
+    // handed to the original object, and closed when it is destroyed.
 
-    Config( Config&& other) :
+    Config( Config&& other) noexcept :
+        _alloc(std::move(other._alloc)),
         _L(other._L),
-        _filename(std::move(other._filename))
+        _filename(std::move(other._filename)),
+        _stats(std::move(other._stats)),
+        _keys(std::move(other._keys))
     {
         other._L = nullptr;
     }
 
-    Config& operator=( Config&& other){
-        _L = other._L;
-        _filename = std::move(other._filename);
-        other._L = nullptr;
+    Config& operator=( Config&& other) noexcept {
+        std::swap(_alloc,other._alloc);
+        std::swap(_L,other._L);
+        std::swap(_filename,other._filename);
+        std::swap(_stats,other._stats);
+        std::swap(_keys,other._keys);
         return *this;
     }
 
@@ -91,6 +197,11 @@ class Config
         return get<T>(key.c_str());
     }
 
+    template<class T>
+    T get( const Path& key){
+        return read<T,Scope>(_L,key);
+    }
+
     // non-throwing version with default
     template< class T>
     T get( const char* key, T def){
@@ -102,6 +213,45 @@ class Config
         return get<T>(key.c_str(),def);
     }
 
+    template< class T>
+    T get( const Path& key, T def){
+        return read<T,Scope>(_L,key,def);
+    }
+
+    // ====================================================
+    // Batched lookup
+    // Tables shared by several keys are visited once (see batch.hpp).
+
+    // Keys of mixed type, returned as a tuple
+    template<class... T, class... K>
+    auto get_many( const K&... keys)
+        -> typename std::enable_if< sizeof...(T) == sizeof...(K), std::tuple<T...>>::type
+    {
+        return read_many<Scope,T...>(_L,PathTrie<Scope>({Path(keys)...}));
+    }
+
+    // Keys of one type, returned as a vector
+    template<class T>
+    std::vector<T> get_many( const std::vector<std::string>& keys){
+        return read_list<T,Scope>(_L,PathTrie<Scope>(to_paths(keys)));
+    }
+
+    template<class T>
+    std::vector<T> get_many( const std::vector<Path>& keys){
+        return read_list<T,Scope>(_L,PathTrie<Scope>(keys));
+    }
+
+    // non-throwing versions with default
+    template<class T>
+    std::vector<T> get_many( const std::vector<std::string>& keys, T def){
+        return read_list<T,Scope>(_L,PathTrie<Scope>(to_paths(keys)),def);
+    }
+
+    template<class T>
+    std::vector<T> get_many( const std::vector<Path>& keys, T def){
+        return read_list<T,Scope>(_L,PathTrie<Scope>(keys),def);
+    }
+
     // ====================================================
     // Write to iterable
 
@@ -116,6 +266,50 @@ class Config
         get(key.c_str(),it,end);
     }
 
+    template< class itype>
+    void get( const Path& key, itype it, itype end){
+        read<itype,Scope>(_L,key,it,end);
+    }
+
+    // ====================================================
+    // Write to contiguous buffer
+    // Reads exactly n elements, throwing if any are missing or of the wrong type.
+
+    template< class T>
+    void get( const char* key, T* out, std::size_t n){
+        read<T,Scope>(_L,key,out,n);
+    }
+
+    template< class T>
+    void get( const std::string& key, T* out, std::size_t n){
+        get(key.c_str(),out,n);
+    }
+
+    template< class T>
+    void get( const Path& key, T* out, std::size_t n){
+        read<T,Scope>(_L,key,out,n);
+    }
+
+    // ====================================================
+    // Read nested tables to flat row-major array
+    // The length of each dimension is written to shape. All nested tables at the same depth must
+    // have the same length.
+
+    template< class T>
+    void get_ndarray( const char* key, std::vector<std::size_t>& shape, std::vector<T>& data){
+        read_ndarray<T,Scope>(_L,key,shape,data);
+    }
+
+    template< class T>
+    void get_ndarray( const std::string& key, std::vector<std::size_t>& shape, std::vector<T>& data){
+        get_ndarray(key.c_str(),shape,data);
+    }
+
+    template< class T>
+    void get_ndarray( const Path& key, std::vector<std::size_t>& shape, std::vector<T>& data){
+        read_ndarray<T,Scope>(_L,key,shape,data);
+    }
+
     // ====================================================
     // Test existance of Lua variable
 
@@ -127,6 +321,10 @@ class Config
         return exists(key.c_str());
     }
 
+    bool exists( const Path& key){
+        return luaconfig::exists<Scope>(_L,key);
+    }
+
     // ====================================================
     // Get size of Lua variable
 
@@ -138,6 +336,10 @@ class Config
         return len(key.c_str());
     }
 
+    std::size_t len( const Path& key){
+        return luaconfig::len<Scope>(_L,key);
+    }
+
     // ====================================================
     // Set a new Lua variable 
 
@@ -151,17 +353,95 @@ class Config
         set( key.c_str(), value);
     }
 
+    template<class T>
+    void set( const Path& key, T value){
+        write<Scope>( _L, key, value);
+    }
+
     // ====================================================
     // Lookup table and use to reconfigure an existing Setting
     // This allows the reuse of a sub-Setting without having
-    // to rebuild a Lua State each time.
+    // to create a new registry reference each time.
     //
     void refocus( Setting& other, const char* key){
-        luaconfig::refocus<Setting,Scope>( _L, other._L, key);
+        luaconfig::refocus<Setting,Scope>( _L, other._ref, key);
     }
 
     void refocus( Setting& other, const std::string& key){
-        luaconfig::refocus<Setting,Scope>( _L, other._L, key.c_str());
+        luaconfig::refocus<Setting,Scope>( _L, other._ref, key.c_str());
+    }
+
+    void refocus( Setting& other, const Path& key){
+        luaconfig::refocus<Setting,Scope>( _L, other._ref, key);
+    }
+
+    // ====================================================
+    // Report memory usage
+    // Live handles and threads that do not fall back to zero over time suggest that Settings or
+    // Functions are being leaked.
+
+    MemoryStats memory_stats(){
+        MemoryStats stats;
+        stats.bytes = _alloc->bytes();
+        stats.peak_bytes = _alloc->peak_bytes();
+        stats.allocations = _alloc->allocations();
+        stats.gc_bytes = 1024*static_cast<std::size_t>(lua_gc(_L,LUA_GCCOUNT,0)) + static_cast<std::size_t>(lua_gc(_L,LUA_GCCOUNTB,0));
+        stats.live_handles = _alloc->handles();
+        stats.live_threads = live_threads(_L);
+        stats.gc_cycles = _alloc->gc_cycles();
+        return stats;
+    }
+
+    // ====================================================
+    // Key cache
+    // Keys are interned the first time they are read, up to a limit of KeyCache::default_limit
+    // keys. A limit of zero disables the cache.
+
+    void set_key_cache_limit( std::size_t limit){
+        _keys->set_limit(limit);
+    }
+
+    std::size_t key_cache_size() const {
+        return _keys->size();
+    }
+
+    // ====================================================
+    // Report hot-path statistics
+    // Always empty unless compiled with LUACONFIG_INSTRUMENT.
+
+    const Stats& stats() const {
+        static const Stats empty;
+        return _stats ? *_stats : empty;
+    }
+
+    // ====================================================
+    // Write global scope as Lua source, which reproduces it when run
+    // Functions and standard libraries are not written. See serialize.hpp.
+
+    void dump( std::FILE* file){
+        FileSink sink(file);
+        serialize_globals(_L,sink);
+    }
+
+    void dump( int fd){
+        FdSink sink(fd);
+        serialize_globals(_L,sink);
+    }
+
+    // Append to string
+    void dump( std::string& out){
+        StringSink sink(out);
+        serialize_globals(_L,sink);
+    }
+
+    // ====================================================
+    // Take immutable copy of global scope, for lock-free reads from any thread
+
+    Snapshot snapshot(){
+        lua_pushglobaltable(_L);
+        Snapshot result(_L,true);
+        lua_pop(_L,1);
+        return result;
     }
 
 };
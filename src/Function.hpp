@@ -1,18 +1,132 @@
 // Function.hpp
 //
-// Encapsulates a lua_State* with a permanent function on its stack.
+// Encapsulates a reference to a Lua function.
 //
-// Implemented similarly to Function in terms of Lua threading.
+// Implemented similarly to Setting in terms of registry references.
 //
 // Templated over return type and arbitrary argument list.
+//
+// Calls are protected: errors raised by the Lua function are thrown as a FunctionException, or a
+// MemoryException if Lua runs out of memory. Arguments are forwarded without copying, and converted
+// to the declared argument types as they are pushed.
 
 #ifndef __LUACONFIG_FUNCTION_HPP
 #define __LUACONFIG_FUNCTION_HPP
 
 #include "core.hpp"
 
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
 namespace luaconfig {
 
+// ============================================================================
+// Call path
+
+// Message handler for lua_pcall, adds traceback to error message
+// A plain C function, so pushing it allocates nothing.
+inline int message_handler( lua_State* L){
+    const char* msg = lua_tostring(L,1);
+    if( msg == nullptr ) msg = lua_pushfstring(L,"(error object is a %s value)",luaL_typename(L,1));
+    luaL_traceback(L,L,msg,1);
+    return 1;
+}
+
+// Push message handler and referenced function for the lifetime of the guard
+// On destruction, the stack is restored to its original size.
+class CallGuard
+{
+    lua_State* _L;
+    int _top;
+
+    public:
+
+    CallGuard( lua_State* L, int ref) : _L(L), _top(lua_gettop(L)) {
+        lua_pushcfunction(L,&message_handler);
+        push_ref(L,ref);
+    }
+
+    ~CallGuard(){
+        lua_settop(_L,_top);
+    }
+
+    // Stack index of message handler
+    int handler() const { return _top+1; }
+
+    CallGuard( const CallGuard&) = delete;
+    CallGuard& operator=( const CallGuard&) = delete;
+};
+
+// Push argument as declared type Arg
+// The argument is only converted if it is not already an Arg, so strings are not copied.
+template<class Arg, class CArg>
+inline void push_arg( lua_State* L, CArg&& arg){
+    cpp_to_stack(L,static_cast<const typename std::decay<Arg>::type&>(arg));
+}
+
+// Call function pushed by guard, with n_args arguments above it
+inline void protected_call( lua_State* L, const CallGuard& guard, int n_args, int n_results){
+    int status = lua_pcall(L,n_args,n_results,guard.handler());
+    if( status != LUA_OK ){
+        std::string msg = lua_tostring(L,-1) ? lua_tostring(L,-1) : "unknown error";
+        if( status == LUA_ERRMEM ) throw MemoryException(msg.c_str());
+        throw FunctionException(msg.c_str());
+    }
+}
+
+// ============================================================================
+// Batched calls
+// Function::map passes inputs to Lua a chunk at a time, and a driver written in Lua loops over each
+// chunk, so that the C++/Lua boundary is crossed once per chunk rather than once per element. The
+// driver is compiled once per Lua State and kept in the registry. It uses no globals, so it is
+// unaffected by anything a config file redefines.
+//
+//     driver(f, n, out, k, a1, ..., ak) sets out[i] = f(a1[i], ..., ak[i]) for i = 1..n
+
+// Number of elements passed to Lua at a time
+static const lua_Integer map_chunk_size = 1024;
+
+inline const void* map_driver_key(){
+    static const char key = 0;
+    return &key;
+}
+
+inline const char* map_driver_source(){
+    return
+        "local function column(args,i,j,k)\n"
+        "    if j <= k then return args[j][i], column(args,i,j+1,k) end\n"
+        "end\n"
+        "return function(f,n,out,k,a,b,c,...)\n"
+        "    if k == 1 then for i=1,n do out[i] = f(a[i]) end\n"
+        "    elseif k == 2 then for i=1,n do out[i] = f(a[i],b[i]) end\n"
+        "    elseif k == 3 then for i=1,n do out[i] = f(a[i],b[i],c[i]) end\n"
+        "    else\n"
+        "        local args = {a,b,c,...}\n"
+        "        for i=1,n do out[i] = f(column(args,i,1,k)) end\n"
+        "    end\n"
+        "end\n";
+}
+
+// Push driver to top of stack, compiling it if necessary
+inline void push_map_driver( lua_State* L){
+    // Side notes follow stack. R=Registry, d=driver
+    if( lua_rawgetp(L,LUA_REGISTRYINDEX,map_driver_key()) == LUA_TFUNCTION ) return; // +1, [d]
+    lua_pop(L,1);                                                                      // +0, []
+    const char* src = map_driver_source();
+    if( luaL_loadbuffer(L,src,std::strlen(src),"=luaconfig_map") != LUA_OK || lua_pcall(L,0,1,0) != LUA_OK ){
+        std::string msg = lua_tostring(L,-1) ? lua_tostring(L,-1) : "unknown error";
+        lua_pop(L,1);
+        throw FunctionException(msg.c_str());
+    }                                                                                  // +1, [d]
+    lua_pushvalue(L,-1);                                                               // +2, [d,d]
+    lua_rawsetp(L,LUA_REGISTRYINDEX,map_driver_key());                                 // +1, [d], R[key] = d
+}
+
+// ============================================================================
 // FunctionBase definition
 // Defines boring things like constructors etc.
 
@@ -21,59 +135,53 @@ class FunctionBase
     protected:
 
     lua_State* _L;
-    int _thread_id;
+    int _ref;
     
     public:
 
     // ====================================================
     // Constructor and Destructor
 
-    FunctionBase( lua_State* p_thread, int thread_id) : _L(p_thread), _thread_id(thread_id) {}
+    FunctionBase( lua_State* L, int ref) : _L(L), _ref(ref) {}
 
     ~FunctionBase(){
-        if( _L != nullptr ){
-            // Remove function from stack
-            lua_pop(_L,1);
-            // Delete thread
-            kill_thread(_L,_thread_id);
-        }
+        if( _L != nullptr ) free_ref(_L,_ref);
     }
 
     // ====================================================
     // Copy constructor, assignment operator
-    // Both are deleted, as a Function object has unique control over the lifetime of a lua_State*.
+    // Copies refer to the same function.
 
-    FunctionBase( const FunctionBase& other){
-        std::tie(_L,_thread_id) = copy_thread(other._L);
-    }
+    FunctionBase( const FunctionBase& other) :
+        _L(other._L),
+        _ref(copy_ref(other._L,other._ref))
+    {}
 
     FunctionBase& operator=( const FunctionBase& other){
-        // Delete current thread
-        if( _L != nullptr ){
-            // Remove table from stack
-            lua_pop(_L,1);
-            // Delete thread
-            kill_thread(_L,_thread_id);
-        }
+        if( this == &other ) return *this;
+        // Release current function
+        if( _L != nullptr ) free_ref(_L,_ref);
         // Copy
-        std::tie(_L,_thread_id) = copy_thread(other._L);
+        _L = other._L;
+        _ref = copy_ref(other._L,other._ref);
+        return *this;
     }
 
     // ====================================================
     // Move constructor / move assignment
     // Both will invalidate the original Function object.
 
-    FunctionBase( FunctionBase&& other) :
+    FunctionBase( FunctionBase&& other) noexcept :
         _L(other._L),
-        _thread_id(other._thread_id)
+        _ref(other._ref)
     {
         other._L = nullptr;
     }
 
-    FunctionBase& operator=( FunctionBase&& other){
-        _L = other._L;
-        _thread_id = other._thread_id;
-        other._L = nullptr;
+    FunctionBase& operator=( FunctionBase&& other) noexcept {
+        // Swap, so that the current reference is released when other is destroyed
+        std::swap(_L,other._L);
+        std::swap(_ref,other._ref);
         return *this;
     }
 };
@@ -96,18 +204,74 @@ class Function< RType(Args...) > : FunctionBase
     // ====================================================
     // Call function
 
-    RType operator() ( Args... args)
+    template<class... CallArgs>
+    RType operator() ( CallArgs&&... args)
     {
-        // Annoyingly, lua_call pops a function from the stack. Must work with a copy of function.
-        lua_pushnil(_L);
-        lua_copy(_L,-2,-1);
+        static_assert( sizeof...(CallArgs) == sizeof...(Args), "Function called with wrong number of arguments");
+        LUACONFIG_TIME(_L,function_call);
+        // Push handler and function. The guard restores the stack afterwards.
+        CallGuard guard(_L,_ref);
         // One by one, push args to stack
-        auto push = {(cpp_to_stack(_L,args),0)...}; (void)push;
+        int push[] = {0,(push_arg<Args>(_L,std::forward<CallArgs>(args)),0)...}; (void)push;
         // Execute Lua function
-        lua_call(_L,sizeof...(Args),1);
+        protected_call(_L,guard,sizeof...(Args),1);
         // Extract and return result
         return stack_to_cpp<RType>(_L);
     }
+
+    // ====================================================
+    // Call function over ranges
+    // Writes f(*first) to out for each element of [first,last), and returns the end of the output.
+    // For functions of several arguments, iterators to the further arguments follow out, in the
+    // manner of std::transform:
+    //
+    //     f.map(x.begin(), x.end(), result.begin(), y.begin(), z.begin()); // result = f(x,y,z)
+
+    template<class InputIt, class OutputIt, class... OtherIts>
+    OutputIt map( InputIt first, InputIt last, OutputIt out, OtherIts... others)
+    {
+        static_assert( 1+sizeof...(OtherIts) == sizeof...(Args), "Function::map requires one input range per argument");
+        LUACONFIG_TIME(_L,function_map);
+        // Side notes follow stack. h=handler, f=function, d=driver, o=outputs, a=inputs
+        if( !lua_checkstack(_L,2*sizeof...(Args)+8) ){
+            throw std::runtime_error("luaconfig: too many arguments to map");
+        }
+        CallGuard guard(_L,_ref);                        // +2, [h,f]
+        int func = lua_gettop(_L);
+        push_map_driver(_L);                             // +3, [h,f,d]
+        int driver = lua_gettop(_L);
+        for( std::size_t j=0; j<=sizeof...(Args); ++j){
+            lua_createtable(_L,map_chunk_size,0);        // +4+k, [h,f,d,o,a1..ak]
+        }
+        while( first != last ){
+            // Fill input tables
+            lua_Integer n = 0;
+            while( n < map_chunk_size && first != last ) push_row(driver+2,++n,first,others...);
+            // Run driver
+            lua_pushvalue(_L,driver);                    // +5+k, [...,d]
+            lua_pushvalue(_L,func);                      // +6+k, [...,d,f]
+            lua_pushinteger(_L,n);                       // +7+k, [...,d,f,n]
+            for( int j=1; j<=1+static_cast<int>(sizeof...(Args)); ++j){
+                lua_pushvalue(_L,driver+j);              // +8+k, [...,d,f,n,o]
+                if( j == 1 ) lua_pushinteger(_L,sizeof...(Args));
+            }                                            // +8+2k, [...,d,f,n,o,k,a1..ak]
+            protected_call(_L,guard,3+1+sizeof...(Args),0); // +4+k, [h,f,d,o,a1..ak]
+            // Read outputs
+            for( lua_Integer i=1; i<=n; ++i, ++out){
+                lua_rawgeti(_L,driver+1,i);
+                *out = stack_to_cpp<RType>(_L);
+            }
+        }
+        return out;
+    }
+
+    private:
+
+    // Push next element of each input to input tables, starting at stack index idx
+    template<class... Its>
+    void push_row( int idx, lua_Integer i, Its&... its){
+        int row[] = {0,(push_arg<Args>(_L,*its),lua_rawseti(_L,idx++,i),(void)++its,0)...}; (void)row;
+    }
 };
 
 // Multiple return type
@@ -122,18 +286,20 @@ class Function<std::tuple<RTypes...>(Args...)> : FunctionBase
     // ====================================================
     // Call function
 
-    std::tuple<RTypes...> operator() ( Args... args)
+    template<class... CallArgs>
+    std::tuple<RTypes...> operator() ( CallArgs&&... args)
     {
-        // Make copy of function.
-        lua_pushnil(_L);
-        lua_copy(_L,-2,-1);
+        static_assert( sizeof...(CallArgs) == sizeof...(Args), "Function called with wrong number of arguments");
+        LUACONFIG_TIME(_L,function_call);
+        // Push handler and function. The guard restores the stack afterwards.
+        CallGuard guard(_L,_ref);
         // One by one, push args to stack
-        auto push = {(cpp_to_stack(_L,args),0)...}; (void)push;
+        int push[] = {0,(push_arg<Args>(_L,std::forward<CallArgs>(args)),0)...}; (void)push;
         // Execute Lua function
-        lua_call(_L,sizeof...(Args),sizeof...(RTypes));
+        protected_call(_L,guard,sizeof...(Args),sizeof...(RTypes));
         // Extract results and return
-        return tuple_from_stack<RTypes...>(_L);;
-    };
+        return tuple_from_stack<RTypes...>(_L);
+    }
 };
 
 } // end namespace
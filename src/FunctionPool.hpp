@@ -0,0 +1,261 @@
+// FunctionPool.hpp
+//
+// Evaluates a Lua function on several threads at once.
+//
+// A Lua State may only be used by one thread at a time, so a Function cannot be shared between
+// threads. Instead, a FunctionPool creates one Config per worker thread from the same source, and
+// looks up the same function in each. Work is divided into tasks, which are queued on the workers
+// in turn. Each worker takes tasks from the back of its own queue, and when that is empty, steals
+// from the front of the others', so that uneven tasks do not leave threads idle.
+//
+//     luaconfig::FunctionPool<double(double)> pool("config.lua","transfer");
+//     pool.parallel_map(x.begin(),x.end(),y.begin());  // y[i] = transfer(x[i])
+//     auto future = pool.submit(2.5);                  // std::future<double>
+//
+// As each worker has its own Lua State, functions should not rely on global state modified by
+// earlier calls. Lua code that only computes a result from its arguments scales with the number of
+// workers.
+
+#ifndef __LUACONFIG_FUNCTIONPOOL_HPP
+#define __LUACONFIG_FUNCTIONPOOL_HPP
+
+#include "Config.hpp"
+#include "Function.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace luaconfig {
+
+template<class Sig>
+class FunctionPool
+{
+    using Func = Function<Sig>;
+    using Task = std::function<void(Func&)>;
+
+    // Each worker owns a Lua State, the function within it, and a queue of tasks
+    struct Worker
+    {
+        std::unique_ptr<Config> cfg;
+        std::unique_ptr<Func> func;
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    // Counts down outstanding tasks of a parallel_map, and keeps the first exception raised
+    struct Latch
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::size_t remaining;
+        std::exception_ptr error;
+
+        explicit Latch( std::size_t n) : remaining(n) {}
+
+        void count_down( std::exception_ptr e){
+            std::lock_guard<std::mutex> lock(mutex);
+            if( e && !error ) error = e;
+            if( --remaining == 0 ) cv.notify_all();
+        }
+
+        void wait(){
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock,[this]{ return remaining == 0; });
+            if( error ) std::rethrow_exception(error);
+        }
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::mutex _mutex;               // Guards sleeping workers
+    std::condition_variable _cv;
+    std::atomic<std::size_t> _queued; // Tasks waiting in any queue
+    std::atomic<std::size_t> _next;   // Worker to receive the next task
+    bool _stop;
+
+    // ====================================================
+    // Scheduling
+
+    void push( std::size_t id, Task task){
+        {
+            // Counted under the worker lock, so that it cannot be taken and counted down first
+            std::lock_guard<std::mutex> lock(_workers[id]->mutex);
+            ++_queued;
+            _workers[id]->tasks.push_back(std::move(task));
+        }
+        // Lock so that a worker about to sleep cannot miss the notification
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cv.notify_one();
+    }
+
+    void push( Task task){
+        push(_next++ % _workers.size(),std::move(task));
+    }
+
+    // Take task from back of own queue
+    bool pop( std::size_t id, Task& task){
+        Worker& w = *_workers[id];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if( w.tasks.empty() ) return false;
+        task = std::move(w.tasks.back());
+        w.tasks.pop_back();
+        --_queued;
+        return true;
+    }
+
+    // Take task from front of another worker's queue
+    bool steal( std::size_t id, Task& task){
+        for( std::size_t k=1; k<_workers.size(); ++k){
+            Worker& w = *_workers[(id+k) % _workers.size()];
+            std::lock_guard<std::mutex> lock(w.mutex);
+            if( w.tasks.empty() ) continue;
+            task = std::move(w.tasks.front());
+            w.tasks.pop_front();
+            --_queued;
+            return true;
+        }
+        return false;
+    }
+
+    void run( std::size_t id){
+        Func& func = *_workers[id]->func;
+        Task task;
+        while( true ){
+            if( pop(id,task) || steal(id,task) ){
+                task(func);
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cv.wait(lock,[this]{ return _stop || _queued > 0; });
+            if( _stop && _queued == 0 ) return;
+        }
+    }
+
+    void start( const std::function<Config()>& make_config, const std::string& key, std::size_t n_workers){
+        if( n_workers == 0 ) n_workers = std::max(1u,std::thread::hardware_concurrency());
+        // States are created on the calling thread, so that load errors are thrown from here
+        for( std::size_t i=0; i<n_workers; ++i){
+            std::unique_ptr<Worker> w(new Worker);
+            w->cfg.reset(new Config(make_config()));
+            w->func.reset(new Func(w->cfg->template get<Func>(key)));
+            _workers.push_back(std::move(w));
+        }
+        // If a thread cannot be started, those already running are joined before rethrowing, as the
+        // destructor is not called
+        try{
+            for( std::size_t i=0; i<n_workers; ++i){
+                _workers[i]->thread = std::thread(&FunctionPool::run,this,i);
+            }
+        } catch(...){
+            stop();
+            throw;
+        }
+    }
+
+    // Wake all workers, and wait for them to finish queued tasks
+    void stop(){
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cv.notify_all();
+        for( auto&& w : _workers) if( w->thread.joinable() ) w->thread.join();
+    }
+
+    public:
+
+    // ====================================================
+    // Constructors and Destructor
+    // A worker count of zero uses one worker per hardware thread.
+
+    // Load each worker's Config from file
+    FunctionPool( const char* filename, const std::string& key, std::size_t n_workers = 0) :
+        _queued(0), _next(0), _stop(false)
+    {
+        std::string name(filename);
+        start([name]{ return Config(name); },key,n_workers);
+    }
+
+    // Create each worker's Config by calling make_config
+    FunctionPool( const std::function<Config()>& make_config, const std::string& key, std::size_t n_workers = 0) :
+        _queued(0), _next(0), _stop(false)
+    {
+        start(make_config,key,n_workers);
+    }
+
+    // Waits for queued tasks to finish
+    ~FunctionPool(){
+        stop();
+    }
+
+    FunctionPool( const FunctionPool&) = delete;
+    FunctionPool& operator=( const FunctionPool&) = delete;
+
+    std::size_t size() const { return _workers.size(); }
+
+    // ====================================================
+    // Call function asynchronously
+
+    template<class... CallArgs>
+    auto submit( CallArgs&&... args) -> std::future<decltype(std::declval<Func&>()(std::forward<CallArgs>(args)...))>
+    {
+        using RType = decltype(std::declval<Func&>()(std::forward<CallArgs>(args)...));
+        auto call = std::make_shared<std::packaged_task<RType(Func&)>>(
+            std::bind([](Func& f, typename std::decay<CallArgs>::type&... a){ return f(a...); },std::placeholders::_1,std::forward<CallArgs>(args)...)
+        );
+        std::future<RType> result = call->get_future();
+        push([call](Func& f){ (*call)(f); });
+        return result;
+    }
+
+    // ====================================================
+    // Call function over ranges in parallel
+    // As Function::map, but the input is split into chunks that are shared among the workers. All
+    // iterators must be random access. Blocks until complete, and rethrows the first exception
+    // raised by any chunk.
+
+    template<class InputIt, class OutputIt, class... OtherIts>
+    OutputIt parallel_map( InputIt first, InputIt last, OutputIt out, OtherIts... others)
+    {
+        static_assert( std::is_base_of<std::random_access_iterator_tag,typename std::iterator_traits<InputIt>::iterator_category>::value,
+            "FunctionPool::parallel_map requires random access iterators");
+        std::size_t n = static_cast<std::size_t>(last-first);
+        if( n == 0 ) return out;
+        // Several chunks per worker, so that work may be rebalanced by stealing
+        std::size_t chunk = std::max<std::size_t>(map_chunk_size,n/(8*_workers.size()));
+        std::size_t n_chunks = (n+chunk-1)/chunk;
+        auto latch = std::make_shared<Latch>(n_chunks);
+        for( std::size_t c=0; c<n_chunks; ++c){
+            std::size_t begin = c*chunk;
+            std::size_t end = std::min(n,begin+chunk);
+            push([=](Func& f){
+                try{
+                    f.map(first+begin,first+end,out+begin,(others+begin)...);
+                    latch->count_down(nullptr);
+                } catch(...){
+                    latch->count_down(std::current_exception());
+                }
+            });
+        }
+        latch->wait();
+        return out+n;
+    }
+};
+
+} // end namespace
+#endif
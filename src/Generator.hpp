@@ -0,0 +1,203 @@
+// Generator.hpp
+//
+// Encapsulates a Lua function that produces a sequence of values with coroutine.yield.
+//
+// The function is run as a coroutine on a thread from the thread pool, and each value is pulled
+// on demand with lua_resume as the iterator is advanced. Only the current value is held at any
+// time, so sequences of any length may be read in constant memory:
+//
+//     -- Lua
+//     function sweep(n)
+//         for i=1,n do coroutine.yield(i/n) end
+//     end
+//
+//     // C++
+//     auto sweep = cfg.get<luaconfig::Generator<double>>("sweep");
+//     for( auto it = sweep.begin(100); it != sweep.end(); ++it) use(*it);
+//
+// The sequence ends when the function returns. Errors raised by the function are thrown as a
+// FunctionException. A Generator supports one pass at a time: calling begin again restarts the
+// function, abandoning any sequence in progress.
+
+#ifndef __LUACONFIG_GENERATOR_HPP
+#define __LUACONFIG_GENERATOR_HPP
+
+#include "core.hpp"
+#include "Function.hpp"
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+
+namespace luaconfig {
+
+template<class T>
+class Generator : FunctionBase
+{
+    lua_State* _co;  // Coroutine, or nullptr if not running
+    int _thread_id;
+    int _n_args;     // Arguments waiting on the coroutine stack for the first resume
+    std::unique_ptr<T> _value; // Current value, held by pointer as handles have no default state
+    bool _done;
+
+    // Return coroutine to the thread pool
+    void release(){
+        if( _co == nullptr ) return;
+        kill_thread(_L,_thread_id);
+        _co = nullptr;
+    }
+
+    // Run coroutine to next yield
+    void advance(){
+        int status = lua_resume(_co,_L,_n_args);
+        _n_args = 0;
+        if( status == LUA_YIELD ){
+            if( lua_gettop(_co) == 0 ) lua_pushnil(_co);
+            lua_settop(_co,1);
+            // Convert on the main state, so that handles do not refer to the pooled coroutine
+            lua_xmove(_co,_L,1);
+            try{
+                type_test<T>(_L,"(yielded value)");
+            } catch(...){
+                lua_pop(_L,1);
+                _done = true;
+                release();
+                throw;
+            }
+            _value.reset(new T(stack_to_cpp<T>(_L)));
+        } else if( status == LUA_OK ){
+            _done = true;
+            release();
+        } else {
+            const char* msg = lua_tostring(_co,-1);
+            luaL_traceback(_L,_co,msg ? msg : "unknown error",0);
+            std::string error = lua_tostring(_L,-1);
+            lua_pop(_L,1);
+            _done = true;
+            release();
+            if( status == LUA_ERRMEM ) throw MemoryException(error.c_str());
+            throw FunctionException(error.c_str());
+        }
+    }
+
+    public:
+
+    // ====================================================
+    // Input iterator over yielded values
+    // The end iterator holds no Generator. Any other iterator compares equal to end once the
+    // sequence is exhausted.
+
+    class iterator
+    {
+        Generator* _gen;
+
+        bool at_end() const { return _gen == nullptr || _gen->_done; }
+
+        public:
+
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        explicit iterator( Generator* gen = nullptr) : _gen(gen) {}
+
+        reference operator*() const { return *_gen->_value; }
+        pointer operator->() const { return _gen->_value.get(); }
+
+        iterator& operator++(){
+            _gen->advance();
+            return *this;
+        }
+
+        // Post-increment returns nothing, as the previous value is not kept
+        void operator++(int){ ++*this; }
+
+        bool operator==( const iterator& other) const {
+            if( at_end() || other.at_end() ) return at_end() && other.at_end();
+            return _gen == other._gen;
+        }
+
+        bool operator!=( const iterator& other) const { return !(*this == other); }
+    };
+
+    // ====================================================
+    // Constructor and Destructor
+
+    Generator( lua_State* L, int ref) : FunctionBase(L,ref), _co(nullptr), _thread_id(0), _n_args(0), _value(), _done(true) {}
+
+    ~Generator(){
+        if( _L != nullptr ) release();
+    }
+
+    // ====================================================
+    // Copy constructor, assignment operator
+    // Copies refer to the same function, but do not share the sequence in progress.
+
+    Generator( const Generator& other) : FunctionBase(other), _co(nullptr), _thread_id(0), _n_args(0), _value(), _done(true) {}
+
+    Generator& operator=( const Generator& other){
+        if( this == &other ) return *this;
+        if( _L != nullptr ) release();
+        FunctionBase::operator=(other);
+        _done = true;
+        return *this;
+    }
+
+    // ====================================================
+    // Move constructor / move assignment
+    // Both will invalidate the original Generator object.
+
+    Generator( Generator&& other) noexcept :
+        FunctionBase(std::move(other)),
+        _co(other._co),
+        _thread_id(other._thread_id),
+        _n_args(other._n_args),
+        _value(std::move(other._value)),
+        _done(other._done)
+    {
+        other._co = nullptr;
+        other._done = true;
+    }
+
+    Generator& operator=( Generator&& other) noexcept {
+        // Swap, so that the current function and coroutine are released when other is destroyed
+        FunctionBase::operator=(std::move(other));
+        std::swap(_co,other._co);
+        std::swap(_thread_id,other._thread_id);
+        std::swap(_n_args,other._n_args);
+        std::swap(_value,other._value);
+        std::swap(_done,other._done);
+        return *this;
+    }
+
+    // ====================================================
+    // Iteration
+
+    // Start function with given arguments, run to first yield
+    template<class... Args>
+    iterator begin( Args&&... args){
+        release();
+        std::tie(_co,_thread_id) = new_thread(_L);
+        _done = false;
+        push_ref(_L,_ref);
+        lua_xmove(_L,_co,1);
+        int push[] = {0,(cpp_to_stack(_co,std::forward<Args>(args)),0)...}; (void)push;
+        _n_args = sizeof...(Args);
+        advance();
+        return iterator(this);
+    }
+
+    iterator end(){
+        return iterator();
+    }
+
+    bool done() const { return _done; }
+};
+
+} // end namespace
+#endif
@@ -0,0 +1,215 @@
+// LayeredConfig.hpp
+//
+// A LayeredConfig composes several sources, such as a base file, per-site settings and per-host
+// overrides. Later layers take priority over earlier ones, and tables are merged key by key:
+//
+//     -- base.lua                        -- host.lua
+//     pool = { size = 4, timeout = 30 }  pool = { size = 16 }
+//
+//     luaconfig::LayeredConfig cfg({"base.lua","host.lua"});
+//     cfg.get<int>("pool.size");    // 16, from host.lua
+//     cfg.get<int>("pool.timeout"); // 30, from base.lua
+//
+// A key is resolved by searching the layers from the last to the first, stopping at the first that
+// defines it. A layer that sets any table along the key to a value other than a table replaces
+// that table entirely, hiding the key in the layers below it. Arrays and other values read whole,
+// such as a Setting or std::vector, come from the single layer that resolves the key, and are not
+// merged.
+//
+// The layer that resolves each key is cached, so a repeated lookup costs a single probe of that
+// layer, however many layers there are. If the layers are changed through layer(i), the cache
+// must be cleared with clear_cache().
+//
+// Each layer is a separate Config. By default, the layers are loaded in parallel, one thread each.
+
+#ifndef __LUACONFIG_LAYEREDCONFIG_HPP
+#define __LUACONFIG_LAYEREDCONFIG_HPP
+
+#include "Config.hpp"
+#include "keys.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace luaconfig {
+
+class LayeredConfig
+{
+    std::vector<Config> _layers;  // Lowest priority first
+    std::unordered_map<std::string,int> _resolved; // Layer resolving each key, or -1 if none
+    std::string _probe;           // Reused for cache lookups, to avoid allocating
+
+    static const int not_found = -1;
+
+    // ====================================================
+    // Resolution
+
+    enum class Presence { absent, present, hidden };
+
+    // Look for key in one layer
+    static Presence presence( lua_State* L, const Path& path){
+        if( path.size() == 0 ) return Presence::absent;
+        int top = lua_gettop(L);
+        lua_to_stack_first<Global>(L,path[0]);
+        Presence result = Presence::present;
+        for( std::size_t i=1; i<path.size(); ++i){
+            if( !lua_istable(L,-1) ){
+                result = lua_isnil(L,-1) ? Presence::absent : Presence::hidden;
+                break;
+            }
+            lua_to_stack_token(L,path[i]);
+        }
+        if( result == Presence::present && lua_isnil(L,-1) ) result = Presence::absent;
+        lua_settop(L,top);
+        return result;
+    }
+
+    int resolve( const Path& path){
+        for( int i = static_cast<int>(_layers.size())-1; i >= 0; --i){
+            Presence p = presence(_layers[i]._L,path);
+            if( p == Presence::present ) return i;
+            if( p == Presence::hidden ) return not_found;
+        }
+        return not_found;
+    }
+
+    // Layer resolving key, using the cache
+    int layer_index( const char* key){
+        _probe.assign(key);
+        auto it = _resolved.find(_probe);
+        if( it != _resolved.end() ) return it->second;
+        int layer = resolve(Path(key));
+        if( _resolved.size() < KeyCache::default_limit ) _resolved.emplace(_probe,layer);
+        return layer;
+    }
+
+    int layer_index( const Path& key){
+        auto it = _resolved.find(key.str());
+        if( it != _resolved.end() ) return it->second;
+        int layer = resolve(key);
+        if( _resolved.size() < KeyCache::default_limit ) _resolved.emplace(key.str(),layer);
+        return layer;
+    }
+
+    void load( const std::vector<std::function<Config()>>& sources, bool parallel){
+        std::vector<std::future<Config>> loading;
+        for( auto&& source : sources){
+            loading.push_back(std::async( parallel ? std::launch::async : std::launch::deferred, source));
+        }
+        // Errors are rethrown from get, lowest layer first
+        for( auto&& l : loading) _layers.push_back(l.get());
+        check_layers();
+    }
+
+    void check_layers() const {
+        if( _layers.empty() ) throw std::runtime_error("luaconfig: LayeredConfig needs at least one layer");
+    }
+
+    public:
+
+    // ====================================================
+    // Constructors
+    // Layers are listed from lowest to highest priority. At least one layer must be given.
+
+    explicit LayeredConfig( const std::vector<std::string>& filenames, bool parallel = true){
+        std::vector<std::function<Config()>> sources;
+        for( auto&& filename : filenames) sources.push_back([filename](){ return Config(filename); });
+        load(sources,parallel);
+    }
+
+    // Preferred for braced lists of filenames, which would otherwise also convert to Configs
+    LayeredConfig( std::initializer_list<std::string> filenames, bool parallel = true) :
+        LayeredConfig(std::vector<std::string>(filenames),parallel) {}
+
+    // Create each layer by calling a function returning a Config
+    explicit LayeredConfig( const std::vector<std::function<Config()>>& sources, bool parallel = true){
+        load(sources,parallel);
+    }
+
+    // Take ownership of Configs already loaded
+    explicit LayeredConfig( std::vector<Config>&& layers) : _layers(std::move(layers)) {
+        check_layers();
+    }
+
+    // ====================================================
+    // Lookup and return Lua variable
+
+    // throwing version
+    // Keys found in no layer are read from the highest layer, so that the usual exception is thrown.
+    template<class T>
+    T get( const char* key){
+        int i = layer_index(key);
+        return _layers[ i == not_found ? _layers.size()-1 : i].get<T>(key);
+    }
+
+    template<class T>
+    T get( const std::string& key){
+        return get<T>(key.c_str());
+    }
+
+    template<class T>
+    T get( const Path& key){
+        int i = layer_index(key);
+        return _layers[ i == not_found ? _layers.size()-1 : i].get<T>(key);
+    }
+
+    // non-throwing version with default
+    template<class T>
+    T get( const char* key, T def){
+        int i = layer_index(key);
+        return ( i == not_found ) ? def : _layers[i].get<T>(key,def);
+    }
+
+    template<class T>
+    T get( const std::string& key, T def){
+        return get<T>(key.c_str(),def);
+    }
+
+    template<class T>
+    T get( const Path& key, T def){
+        int i = layer_index(key);
+        return ( i == not_found ) ? def : _layers[i].get<T>(key,def);
+    }
+
+    // ====================================================
+    // Test existance of a variable
+
+    bool exists( const char* key){
+        return layer_index(key) != not_found;
+    }
+
+    bool exists( const std::string& key){
+        return exists(key.c_str());
+    }
+
+    bool exists( const Path& key){
+        return layer_index(key) != not_found;
+    }
+
+    // ====================================================
+    // Layers
+
+    // Index of layer resolving key, or -1 if none does
+    int layer_of( const char* key){
+        return layer_index(key);
+    }
+
+    int layer_of( const std::string& key){
+        return layer_index(key.c_str());
+    }
+
+    std::size_t size() const { return _layers.size(); }
+
+    Config& layer( std::size_t i){ return _layers[i]; }
+
+    void clear_cache(){ _resolved.clear(); }
+};
+
+} // end namespace
+#endif
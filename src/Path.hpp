@@ -0,0 +1,105 @@
+// Path.hpp
+//
+// A Path is a dot-notation key that has been parsed ahead of time.
+//
+// Lookups using a plain string key must split the key into tokens and decide whether each token is
+// a text key or an integer index on every call. A Path does this once on construction, so repeated
+// lookups of the same key perform no string parsing and no memory allocation. The key is also hashed
+// once, so finding it in a Config's key cache does not rehash it. Paths are not tied to any
+// particular Config, and may be shared between them.
+//
+// Paths may be passed to get, exists, len, set and refocus in place of a string key:
+//
+//     luaconfig::Path path("table.x.1.y");
+//     for(...) auto y = cfg.get<double>(path);
+
+#ifndef __LUACONFIG_PATH_HPP
+#define __LUACONFIG_PATH_HPP
+
+extern "C" {
+#include <lua.h>
+}
+
+#include "utils.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace luaconfig {
+
+// Split dot-notation key into tokens
+// Sets tk and len to the next token following p, and advances p beyond it. Empty tokens are
+// skipped. Returns false when there are no tokens remaining.
+inline bool next_token( const char*& p, const char*& tk, std::size_t& len){
+    while( *p == '.' ) ++p;
+    if( *p == '\0' ) return false;
+    tk = p;
+    while( *p != '.' && *p != '\0' ) ++p;
+    len = static_cast<std::size_t>(p-tk);
+    return true;
+}
+
+// Does token represent an integer index?
+// As with atoi, the leading digits are used and anything following them is ignored.
+inline bool token_is_index( const char* tk){
+    return *tk >= '0' && *tk <= '9';
+}
+
+inline lua_Integer token_to_index( const char* tk, std::size_t len){
+    lua_Integer index = 0;
+    for( std::size_t i=0; i<len && tk[i] >= '0' && tk[i] <= '9'; ++i) index = 10*index + (tk[i]-'0');
+    return index;
+}
+
+class Path
+{
+    public:
+
+    struct Token {
+        std::string key;   // Text of token
+        lua_Integer index; // Integer index, if is_index
+        bool is_index;
+    };
+
+    private:
+
+    std::string _str;
+    std::vector<Token> _tokens;
+    std::size_t _hash;  // Of _str, as used by KeyCache
+
+    public:
+
+    // ====================================================
+    // Constructors
+
+    explicit Path( const char* key) : _str(key), _hash(static_cast<std::size_t>(fnv1a(_str.data(),_str.size()))) {
+        const char* p = key;
+        const char* tk;
+        std::size_t len;
+        while( next_token(p,tk,len) ){
+            bool is_index = token_is_index(tk);
+            _tokens.push_back( Token{ std::string(tk,len), is_index ? token_to_index(tk,len) : 0, is_index});
+        }
+    }
+
+    explicit Path( const std::string& key) : Path(key.c_str()) {}
+
+    // ====================================================
+    // Access
+
+    // Original key
+    const char* c_str() const { return _str.c_str(); }
+    const std::string& str() const { return _str; }
+    std::size_t hash() const { return _hash; }
+
+    // Tokens
+    std::size_t size() const { return _tokens.size(); }
+    const Token& operator[]( std::size_t i) const { return _tokens[i]; }
+
+    std::vector<Token>::const_iterator begin() const { return _tokens.begin(); }
+    std::vector<Token>::const_iterator end() const { return _tokens.end(); }
+};
+
+} // end namespace
+#endif
@@ -0,0 +1,373 @@
+// ReloadingConfig.hpp
+//
+// A ReloadingConfig follows changes to a configuration file while the program runs.
+//
+// A background thread watches the file, using inotify on Linux, and otherwise (or in addition)
+// checking its size, modification time and inode every poll interval. When it changes, the file is
+// run into a fresh Config on the watcher thread, so readers never wait for Lua. The new version is
+// then published with a single atomic store of a shared_ptr. Readers atomically load the current
+// version and keep it alive for as long as they hold it, so a reload never invalidates anything a
+// reader is using. Old versions are freed when their last reader lets go.
+//
+// Each version holds the Config and a Snapshot of its global scope:
+//
+//     luaconfig::ReloadingConfig cfg("settings.lua");
+//     auto x = cfg.get<double>("table.x");          // from the current Snapshot, any thread
+//     auto f = cfg.pin<luaconfig::Function<double(double)>>("f");
+//
+// Reads through get() use the Snapshot, and may be made from any number of threads. Settings and
+// Functions must come from the version's Config. pin() returns one in a shared_ptr that also keeps
+// its version alive, so it continues to refer to the file as it was when the handle was created.
+// pin() may be called from any thread, as it holds the version's mutex while using its Config.
+// Handles pinned from one version share its Lua State, so any that are used from more than one
+// thread must be used while holding that version's mutex:
+//
+//     auto v = cfg.current();
+//     auto f = cfg.pin<luaconfig::Function<double(double)>>(v,"f");
+//     std::lock_guard<std::mutex> lock(v->mutex);
+//     (*f)(2);
+//
+// A file that fails to load is reported through last_error(), and the previous version remains
+// current. Only the constructor's initial load throws.
+//
+// Components may subscribe to the keys they use, and are told after each reload which of those
+// keys changed, as found by diffing the old and new Snapshots (see diff.hpp):
+//
+//     cfg.on_change("pools.*.size",[]( const luaconfig::ReloadingConfig::Version& v, const std::vector<std::string>& keys){
+//         for( auto&& key : keys) resize(key, v.snapshot.get<int>(key,0));
+//     });
+//
+// Callbacks run on the thread that performed the reload, once the new version is current, and
+// must not call reload() themselves.
+
+#ifndef __LUACONFIG_RELOADINGCONFIG_HPP
+#define __LUACONFIG_RELOADINGCONFIG_HPP
+
+#include "Config.hpp"
+#include "Snapshot.hpp"
+#include "diff.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace luaconfig {
+
+class ReloadingConfig
+{
+    public:
+
+    // ====================================================
+    // One loaded version of the file
+
+    struct Version
+    {
+        Config config;
+        Snapshot snapshot;   // Of global scope
+        std::uint64_t number; // Counts from 1 for the initial load
+        std::mutex mutex;     // Guards use of config, and of handles taken from it
+
+        Version( Config&& cfg, std::uint64_t number) : config(std::move(cfg)), snapshot(config.snapshot()), number(number) {}
+    };
+
+    // Called with the new version, and the changed keys matching a pattern
+    using Callback = std::function<void( const Version&, const std::vector<std::string>&)>;
+
+    private:
+
+    // Identity of file contents, as far as can be told without reading it
+    struct FileSignature
+    {
+        dev_t dev = 0;
+        ino_t ino = 0;
+        off_t size = -1;
+        std::int64_t mtime_ns = 0;
+
+        bool operator==( const FileSignature& other) const {
+            return dev == other.dev && ino == other.ino && size == other.size && mtime_ns == other.mtime_ns;
+        }
+    };
+
+    static FileSignature file_signature( const char* filename){
+        FileSignature sig;
+        struct stat st;
+        if( ::stat(filename,&st) != 0 ) return sig;
+        sig.dev = st.st_dev;
+        sig.ino = st.st_ino;
+        sig.size = st.st_size;
+#ifdef __linux__
+        sig.mtime_ns = static_cast<std::int64_t>(st.st_mtim.tv_sec)*1000000000 + st.st_mtim.tv_nsec;
+#else
+        sig.mtime_ns = static_cast<std::int64_t>(st.st_mtime)*1000000000;
+#endif
+        return sig;
+    }
+
+    std::string _filename;
+    std::chrono::milliseconds _interval;
+    std::shared_ptr<Version> _current; // Only accessed through std::atomic_load and std::atomic_store
+    std::mutex _reload_mutex;          // Serialises reloads, and guards _error and _signature
+    std::string _error;
+    FileSignature _signature;
+    std::mutex _notify_mutex;          // Keeps notifications in the order of reloads
+    struct Listener {
+        std::size_t id;
+        std::string pattern;
+        Callback callback;
+    };
+    std::vector<Listener> _listeners;
+    std::size_t _next_id;
+    std::mutex _listener_mutex;        // Guards _listeners and _next_id
+    int _wake[2];                      // Pipe, written to stop the watcher
+    int _inotify;                      // inotify descriptor, or -1 if not watching
+    std::thread _watcher;
+
+    // ====================================================
+    // Watcher thread
+
+    // Read pending inotify events, report whether any concern the file
+    bool drain_events( const std::string& name){
+        bool changed = false;
+#ifdef __linux__
+        alignas(struct inotify_event) char buffer[4096];
+        ssize_t n;
+        while( (n = ::read(_inotify,buffer,sizeof(buffer))) > 0 ){
+            for( char* p = buffer; p < buffer+n; ){
+                const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+                if( event->len != 0 && name == event->name ) changed = true;
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+#else
+        (void)name;
+#endif
+        return changed;
+    }
+
+    void watch(){
+        std::size_t slash = _filename.find_last_of('/');
+        std::string name = ( slash == std::string::npos ) ? _filename : _filename.substr(slash+1);
+        struct pollfd fds[2];
+        fds[0].fd = _wake[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = _inotify;
+        fds[1].events = POLLIN;
+        nfds_t nfds = ( _inotify >= 0 ) ? 2 : 1;
+        while( true ){
+            fds[0].revents = fds[1].revents = 0;
+            int n = ::poll(fds,nfds,static_cast<int>(_interval.count()));
+            if( n < 0 && errno == EINTR ) continue;
+            if( fds[0].revents != 0 ) return;
+            // Events force a reload, as modification times may be too coarse to show a change.
+            // Polling catches anything inotify misses, such as changes through symlinked directories.
+            bool changed = ( fds[1].revents & POLLIN ) && drain_events(name);
+            reload_if(changed);
+        }
+    }
+
+    // Reload if forced, or if the file's signature has changed
+    bool reload_if( bool force){
+        std::unique_lock<std::mutex> lock(_reload_mutex);
+        FileSignature sig = file_signature(_filename.c_str());
+        if( !force && sig == _signature ) return false;
+        _signature = sig;
+        std::shared_ptr<Version> before = std::atomic_load(&_current);
+        std::shared_ptr<Version> after;
+        try{
+            after = std::make_shared<Version>(Config(_filename.c_str()),before->number+1);
+        } catch( const std::exception& e){
+            _error = e.what();
+            return false;
+        }
+        std::atomic_store(&_current,after);
+        _error.clear();
+        // Hand over to the notification lock before releasing the reload lock, so that callbacks
+        // may read last_error() while later reloads wait their turn.
+        std::lock_guard<std::mutex> notify_lock(_notify_mutex);
+        lock.unlock();
+        notify(*before,*after);
+        return true;
+    }
+
+    void notify( const Version& before, const Version& after){
+        std::vector<Listener> listeners;
+        {
+            std::lock_guard<std::mutex> lock(_listener_mutex);
+            listeners = _listeners;
+        }
+        if( listeners.empty() ) return;
+        std::vector<std::string> changed = diff(before.snapshot,after.snapshot);
+        if( changed.empty() ) return;
+        for( auto&& listener : listeners){
+            std::vector<std::string> matched;
+            for( auto&& key : changed) if( key_matches(listener.pattern,key) ) matched.push_back(key);
+            if( !matched.empty() ) listener.callback(after,matched);
+        }
+    }
+
+    public:
+
+    // ====================================================
+    // Constructor and Destructor
+
+    // Load file, throwing on failure, then watch it for changes
+    // If watched is false, the file is only reloaded by calls to reload().
+    explicit ReloadingConfig( const char* filename, std::chrono::milliseconds interval = std::chrono::milliseconds(500), bool watched = true) :
+        _filename(filename),
+        _interval(interval),
+        _signature(file_signature(filename)),
+        _next_id(0),
+        _inotify(-1)
+    {
+        std::atomic_store(&_current,std::make_shared<Version>(Config(filename),1));
+        _wake[0] = _wake[1] = -1;
+        if( !watched ) return;
+        if( ::pipe(_wake) != 0 ){
+            throw FileException((std::string("cannot create pipe to watch ") + filename + ": " + std::strerror(errno)).c_str());
+        }
+#ifdef __linux__
+        _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if( _inotify >= 0 ){
+            // Watch the directory, as editors often replace files rather than writing to them
+            std::size_t slash = _filename.find_last_of('/');
+            std::string dir = ( slash == std::string::npos ) ? "." : ( slash == 0 ? "/" : _filename.substr(0,slash) );
+            if( inotify_add_watch(_inotify,dir.c_str(),IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0 ){
+                ::close(_inotify);
+                _inotify = -1;
+            }
+        }
+#endif
+        _watcher = std::thread(&ReloadingConfig::watch,this);
+    }
+
+    explicit ReloadingConfig( const std::string& filename, std::chrono::milliseconds interval = std::chrono::milliseconds(500), bool watched = true) :
+        ReloadingConfig(filename.c_str(),interval,watched) {}
+
+    ~ReloadingConfig(){
+        if( !_watcher.joinable() ) return;
+        char c = 0;
+        while( ::write(_wake[1],&c,1) < 0 && errno == EINTR ) {}
+        _watcher.join();
+        ::close(_wake[0]);
+        ::close(_wake[1]);
+        if( _inotify >= 0 ) ::close(_inotify);
+    }
+
+    // ====================================================
+    // Copy and move are deleted, as the watcher thread refers to this object
+
+    ReloadingConfig( const ReloadingConfig&) = delete;
+    ReloadingConfig& operator=( const ReloadingConfig&) = delete;
+
+    // ====================================================
+    // Current version
+    // The returned version remains valid for as long as it is held, whatever happens to the file.
+
+    std::shared_ptr<Version> current() const {
+        return std::atomic_load(&_current);
+    }
+
+    Snapshot snapshot() const {
+        return current()->snapshot;
+    }
+
+    std::uint64_t version() const {
+        return current()->number;
+    }
+
+    // ====================================================
+    // Lookup and return value from the current Snapshot
+    // Keys may be anything accepted by Snapshot::get.
+
+    // throwing version
+    template<class T, class K>
+    T get( const K& key) const {
+        return current()->snapshot.template get<T>(key);
+    }
+
+    // non-throwing version with default
+    template<class T, class K>
+    T get( const K& key, T def) const {
+        return current()->snapshot.template get<T>(key,def);
+    }
+
+    // ====================================================
+    // Setting or Function from the current Config, which keeps its version alive
+
+    // From a given version
+    template<class T, class K>
+    static std::shared_ptr<T> pin( const std::shared_ptr<Version>& version, const K& key){
+        std::lock_guard<std::mutex> lock(version->mutex);
+        std::unique_ptr<T> handle(new T(version->config.template get<T>(key)));
+        // The deleter holds the version, so it outlives the handle. Releasing the handle also
+        // uses the version's Lua State.
+        return std::shared_ptr<T>(handle.release(),[version]( T* p){
+            std::lock_guard<std::mutex> lock(version->mutex);
+            delete p;
+        });
+    }
+
+    template<class T, class K>
+    std::shared_ptr<T> pin( const K& key){
+        return pin<T>(current(),key);
+    }
+
+    // ====================================================
+    // Reloading
+
+    // Reload now, whether or not the file has changed
+    // Returns false if the file failed to load, in which case the error is given by last_error().
+    bool reload(){
+        return reload_if(true);
+    }
+
+    // ====================================================
+    // Change notification
+    // Patterns are dot-notation keys, in which '*' matches any one token and '**' any number of
+    // trailing tokens. Returns an id for remove_on_change.
+
+    std::size_t on_change( const std::string& pattern, Callback callback){
+        std::lock_guard<std::mutex> lock(_listener_mutex);
+        _listeners.push_back( Listener{ _next_id, pattern, std::move(callback)});
+        return _next_id++;
+    }
+
+    void remove_on_change( std::size_t id){
+        std::lock_guard<std::mutex> lock(_listener_mutex);
+        for( auto it = _listeners.begin(); it != _listeners.end(); ++it){
+            if( it->id == id ){
+                _listeners.erase(it);
+                return;
+            }
+        }
+    }
+
+    // ====================================================
+    // Errors
+
+    // Error from most recent reload, or an empty string if it succeeded
+    std::string last_error(){
+        std::lock_guard<std::mutex> lock(_reload_mutex);
+        return _error;
+    }
+
+    const std::string& filename() const { return _filename; }
+};
+
+} // end namespace
+#endif
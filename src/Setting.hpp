@@ -1,13 +1,14 @@
 // Setting.hpp
 //
-// A Setting object encapsulates a lua_State* with a permanent table on its stack.
+// A Setting object encapsulates a reference to a Lua table.
 // It offers similar methods to Config, such as get/set, though these act within a table
 // rather than at global scope. It additionally allows integer-indexing for get/set.
 //
-// It is implemented using Lua threads; on creation, a new thread is created and the desired table
-// is moved onto it. This thread resides at global scope in Lua. The lifetime of the thread is determined
-// by the lifetime of the Setting; once the Setting moves out of scope, its corresponding Lua thread is
-// set to the value 'nil'.
+// It is implemented using registry references; on creation, the desired table is stored in the
+// registry, and the Setting holds its integer reference alongside the owning lua_State*. Each
+// operation pushes the table to the top of the stack, acts on it, and restores the stack. The
+// lifetime of the reference is determined by the lifetime of the Setting; once the Setting moves out
+// of scope, the reference is released and the table may be garbage collected.
 // 
 // It is highly recommended that the user does not call a Setting's constructor directly. Instead, it is
 // recommended to create them using Config::get or Setting::get.
@@ -16,6 +17,11 @@
 #define __LUACONFIG_SETTING_HPP
 
 #include "core.hpp"
+#include "batch.hpp"
+#include "binding.hpp"
+#include "serialize.hpp"
+#include "Snapshot.hpp"
+#include "TableIterator.hpp"
 #include "utils.hpp"
 
 namespace luaconfig {
@@ -27,7 +33,7 @@ class Setting
     private:
 
     lua_State* _L;
-    int _thread_id;
+    int _ref;
 
     using Scope = Table;
 
@@ -36,52 +42,57 @@ class Setting
     // ====================================================
     // Constructor and Destructor
 
-    Setting( lua_State* p_thread, int thread_id) : _L(p_thread), _thread_id(thread_id) {}
+    Setting( lua_State* L, int ref) : _L(L), _ref(ref) {
+        LUACONFIG_COUNT(_L,settings_created);
+    }
 
     ~Setting(){
         if( _L != nullptr ){
-            // Remove table from stack
-            lua_pop(_L,1);
-            // Delete thread
-            kill_thread(_L,_thread_id);
+            LUACONFIG_COUNT(_L,settings_destroyed);
+            free_ref(_L,_ref);
         }
     }
 
     // ====================================================
     // Copy constructor, assignment operator
-    // Both are deleted, as a Setting object has unique control over the lifetime of a lua_State*.
+    // Copies refer to the same table.
 
-    Setting( const Setting& other){
-        std::tie(_L,_thread_id) = copy_thread(other._L);
+    Setting( const Setting& other) :
+        _L(other._L),
+        _ref(copy_ref(other._L,other._ref))
+    {
+        LUACONFIG_COUNT(_L,settings_created);
     }
 
     Setting& operator=( const Setting& other){
-        // Delete current thread
+        if( this == &other ) return *this;
+        // Release current table
         if( _L != nullptr ){
-            // Remove table from stack
-            lua_pop(_L,1);
-            // Delete thread
-            kill_thread(_L,_thread_id);
+            LUACONFIG_COUNT(_L,settings_destroyed);
+            free_ref(_L,_ref);
         }
         // Copy
-        std::tie(_L,_thread_id) = copy_thread(other._L);
+        _L = other._L;
+        _ref = copy_ref(other._L,other._ref);
+        LUACONFIG_COUNT(_L,settings_created);
+        return *this;
     }
 
     // ====================================================
     // Move constructor / move assignment
     // Both will invalidate the original Setting object.
 
-    Setting( Setting&& other) :
+    Setting( Setting&& other) noexcept :
         _L(other._L),
-        _thread_id(other._thread_id)
+        _ref(other._ref)
     {
         other._L = nullptr;
     }
 
-    Setting& operator=( Setting&& other){
-        _L = other._L;
-        _thread_id = other._thread_id;
-        other._L = nullptr;
+    Setting& operator=( Setting&& other) noexcept {
+        // Swap, so that the current reference is released when other is destroyed
+        std::swap(_L,other._L);
+        std::swap(_ref,other._ref);
         return *this;
     }
 
@@ -91,6 +102,7 @@ class Setting
     // throwing version
     template<class T>
     T get( const char* key){
+        RefGuard guard(_L,_ref);
         return read<T,Scope>(_L,key);
     }
 
@@ -99,14 +111,22 @@ class Setting
         return get<T>(key.c_str());
     }
 
+    template<class T>
+    T get( const Path& key){
+        RefGuard guard(_L,_ref);
+        return read<T,Scope>(_L,key);
+    }
+
     template<class T>
     T get( int key){
+        RefGuard guard(_L,_ref);
         return read<T,Scope>(_L,key);
     }
 
     // non-throwing version with default
     template<class T>
     T get( const char* key, T def){
+        RefGuard guard(_L,_ref);
         return read<T,Scope>(_L,key,def);
     }
 
@@ -115,17 +135,64 @@ class Setting
         return get<T>(key.c_str(),def);
     }
 
+    template<class T>
+    T get( const Path& key, T def){
+        RefGuard guard(_L,_ref);
+        return read<T,Scope>(_L,key,def);
+    }
+
     template<class T>
     T get( int key, T def){
+        RefGuard guard(_L,_ref);
         return read<T,Scope>(_L,key,def);
     }
 
+    // ====================================================
+    // Batched lookup
+    // Tables shared by several keys are visited once (see batch.hpp).
+
+    // Keys of mixed type, returned as a tuple
+    template<class... T, class... K>
+    auto get_many( const K&... keys)
+        -> typename std::enable_if< sizeof...(T) == sizeof...(K), std::tuple<T...>>::type
+    {
+        RefGuard guard(_L,_ref);
+        return read_many<Scope,T...>(_L,PathTrie<Scope>({Path(keys)...}));
+    }
+
+    // Keys of one type, returned as a vector
+    template<class T>
+    std::vector<T> get_many( const std::vector<std::string>& keys){
+        RefGuard guard(_L,_ref);
+        return read_list<T,Scope>(_L,PathTrie<Scope>(to_paths(keys)));
+    }
+
+    template<class T>
+    std::vector<T> get_many( const std::vector<Path>& keys){
+        RefGuard guard(_L,_ref);
+        return read_list<T,Scope>(_L,PathTrie<Scope>(keys));
+    }
+
+    // non-throwing versions with default
+    template<class T>
+    std::vector<T> get_many( const std::vector<std::string>& keys, T def){
+        RefGuard guard(_L,_ref);
+        return read_list<T,Scope>(_L,PathTrie<Scope>(to_paths(keys)),def);
+    }
+
+    template<class T>
+    std::vector<T> get_many( const std::vector<Path>& keys, T def){
+        RefGuard guard(_L,_ref);
+        return read_list<T,Scope>(_L,PathTrie<Scope>(keys),def);
+    }
+
     // ====================================================
     // Write to iterable
 
     // iterable version
     template< class itype>
     void get( const char* key, itype it, itype end){
+        RefGuard guard(_L,_ref);
         read<itype,Scope>(_L,key,it,end);
     }
 
@@ -134,15 +201,78 @@ class Setting
         get(key.c_str(),it,end);
     }
 
+    template< class itype>
+    void get( const Path& key, itype it, itype end){
+        RefGuard guard(_L,_ref);
+        read<itype,Scope>(_L,key,it,end);
+    }
+
     template< class itype>
     void get( int key, itype it, itype end){
+        RefGuard guard(_L,_ref);
         read<itype,Scope>(_L,key,it,end);
     }
 
+    // ====================================================
+    // Write to contiguous buffer
+    // Reads exactly n elements, throwing if any are missing or of the wrong type.
+
+    template< class T>
+    void get( const char* key, T* out, std::size_t n){
+        RefGuard guard(_L,_ref);
+        read<T,Scope>(_L,key,out,n);
+    }
+
+    template< class T>
+    void get( const std::string& key, T* out, std::size_t n){
+        get(key.c_str(),out,n);
+    }
+
+    template< class T>
+    void get( const Path& key, T* out, std::size_t n){
+        RefGuard guard(_L,_ref);
+        read<T,Scope>(_L,key,out,n);
+    }
+
+    template< class T>
+    void get( int key, T* out, std::size_t n){
+        RefGuard guard(_L,_ref);
+        read<T,Scope>(_L,key,out,n);
+    }
+
+    // ====================================================
+    // Read nested tables to flat row-major array
+    // The length of each dimension is written to shape. All nested tables at the same depth must
+    // have the same length.
+
+    template< class T>
+    void get_ndarray( const char* key, std::vector<std::size_t>& shape, std::vector<T>& data){
+        RefGuard guard(_L,_ref);
+        read_ndarray<T,Scope>(_L,key,shape,data);
+    }
+
+    template< class T>
+    void get_ndarray( const std::string& key, std::vector<std::size_t>& shape, std::vector<T>& data){
+        get_ndarray(key.c_str(),shape,data);
+    }
+
+    template< class T>
+    void get_ndarray( const Path& key, std::vector<std::size_t>& shape, std::vector<T>& data){
+        RefGuard guard(_L,_ref);
+        read_ndarray<T,Scope>(_L,key,shape,data);
+    }
+
+    template< class T>
+    void get_ndarray( int key, std::vector<std::size_t>& shape, std::vector<T>& data){
+        RefGuard guard(_L,_ref);
+        read_ndarray<T,Scope>(_L,key,shape,data);
+    }
+
     // ====================================================
     // Test existance of Lua variable
 
     bool exists( const char* key){
+        RefGuard guard(_L,_ref);
         return luaconfig::exists<Scope>(_L,key);
     }
 
@@ -150,7 +280,13 @@ class Setting
         return exists(key.c_str());
     }
 
+    bool exists( const Path& key){
+        RefGuard guard(_L,_ref);
+        return luaconfig::exists<Scope>(_L,key);
+    }
+
     bool exists( int index){
+        RefGuard guard(_L,_ref);
         return luaconfig::exists<Scope>(_L,index);
     }
 
@@ -159,6 +295,7 @@ class Setting
 
     template<class T>
     void set( const char* key, T value){
+        RefGuard guard(_L,_ref);
         write<Scope>( _L, key, value);
     }
 
@@ -167,8 +304,15 @@ class Setting
         set( key.c_str(), value);
     }
 
+    template<class T>
+    void set( const Path& key, T value){
+        RefGuard guard(_L,_ref);
+        write<Scope>( _L, key, value);
+    }
+
     template<class T>
     void set( int key, T value){
+        RefGuard guard(_L,_ref);
         write<Scope>( _L, key, value);
     }
 
@@ -177,6 +321,7 @@ class Setting
     // Reminder: Lua indexing goes from 1 to len, not 0 to len-1!
     
     std::size_t len(){
+        RefGuard guard(_L,_ref);
         lua_len(_L,-1);
         return stack_to_cpp<std::size_t>(_L);
     }
@@ -186,6 +331,7 @@ class Setting
     // Reminder: Lua indexing goes from 1 to len, not 0 to len-1!
 
     std::size_t len( const char* key){
+        RefGuard guard(_L,_ref);
         return luaconfig::len<Scope>(_L,key);
     }
 
@@ -193,25 +339,91 @@ class Setting
         return len(key.c_str());
     }
 
+    std::size_t len( const Path& key){
+        RefGuard guard(_L,_ref);
+        return luaconfig::len<Scope>(_L,key);
+    }
+
     std::size_t len( int key){
+        RefGuard guard(_L,_ref);
         return luaconfig::len<Scope>(_L,key);
     }
 
     // ====================================================
     // Lookup table and use to reconfigure an existing Setting
     // This allows the reuse of a sub-Setting without having
-    // to rebuild a Lua State each time.
+    // to create a new registry reference each time.
 
     void refocus( Setting& other, const char* key){
-        luaconfig::refocus<Setting,Scope>( _L, other._L, key);
+        RefGuard guard(_L,_ref);
+        luaconfig::refocus<Setting,Scope>( _L, other._ref, key);
     }
 
     void refocus( Setting& other, const std::string& key){
-        luaconfig::refocus<Setting,Scope>( _L, other._L, key.c_str());
+        RefGuard guard(_L,_ref);
+        luaconfig::refocus<Setting,Scope>( _L, other._ref, key.c_str());
+    }
+
+    void refocus( Setting& other, const Path& key){
+        RefGuard guard(_L,_ref);
+        luaconfig::refocus<Setting,Scope>( _L, other._ref, key);
     }
 
     void refocus( Setting& other, int index){
-        luaconfig::refocus<Setting,Scope>( _L, other._L, index);
+        RefGuard guard(_L,_ref);
+        luaconfig::refocus<Setting,Scope>( _L, other._ref, index);
+    }
+
+    // ====================================================
+    // Write table as a Lua table constructor
+    // Functions are not written. See serialize.hpp.
+
+    void dump( std::FILE* file) const {
+        RefGuard guard(_L,_ref);
+        FileSink sink(file);
+        serialize_table(_L,sink);
+    }
+
+    void dump( int fd) const {
+        RefGuard guard(_L,_ref);
+        FdSink sink(fd);
+        serialize_table(_L,sink);
+    }
+
+    // Append to string
+    void dump( std::string& out) const {
+        RefGuard guard(_L,_ref);
+        StringSink sink(out);
+        serialize_table(_L,sink);
+    }
+
+    // ====================================================
+    // Take immutable copy of table, for lock-free reads from any thread
+
+    Snapshot snapshot(){
+        RefGuard guard(_L,_ref);
+        return Snapshot(_L);
+    }
+
+    // ====================================================
+    // Iterate over entries
+    // pairs visits every key in no particular order, ipairs visits 1,2,3... up to the first nil.
+    // Iterating over the Setting itself is equivalent to pairs.
+
+    TableView pairs() const {
+        return TableView(_L,_ref,false);
+    }
+
+    TableView ipairs() const {
+        return TableView(_L,_ref,true);
+    }
+
+    TableIterator begin() const {
+        return TableIterator(_L,_ref,false);
+    }
+
+    TableIterator end() const {
+        return TableIterator();
     }
 
 };
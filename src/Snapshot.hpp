@@ -0,0 +1,863 @@
+// Snapshot.hpp
+//
+// A Snapshot is an immutable copy of a Lua table, taken at a single moment in time.
+//
+// Reading from a Config or Setting involves calls to the Lua API, and a lua_State may only be used by
+// one thread at a time. A Snapshot walks a table once and stores its contents as plain C++ data, after
+// which reads are pure memory lookups. As a Snapshot is never modified, it may be shared between any
+// number of threads without locking. Copying a Snapshot is cheap, as copies share the same data.
+//
+// The contents are stored in three flat arrays:
+//     nodes   -- one per value. Tables refer to a contiguous range of entries.
+//     entries -- (key,value) pairs. Within each table, integer keys are sorted ahead of string keys,
+//                so that lookups may use a binary search.
+//     strings -- pool of all string keys and values, each stored once and null-terminated.
+// Nodes and entries refer to one another by index rather than by pointer, so that the data is
+// independent of its location in memory. Each node also records a hash of its value, covering all
+// contents in the case of tables, so that snapshots may be compared a subtree at a time (diff.hpp).
+//
+// As the arrays contain no pointers, they may also be saved as a binary image, and later mapped
+// read-only into any number of processes. A mapped Snapshot needs no Lua State, and is ready as
+// soon as the file is mapped; processes mapping the same image share its physical pages:
+//
+//     cfg.snapshot().save("settings.img");                           // once
+//     auto snap = luaconfig::Snapshot::map("settings.img");          // in each worker
+//
+// Snapshots offer similar get/exists/len methods to Config and Setting:
+//
+//     luaconfig::Snapshot snap = cfg.snapshot();
+//     auto x = snap.get<double>("table.x.1.y");
+//     auto sub = snap.get<luaconfig::Snapshot>("table");
+//
+// Functions are recorded as present, but cannot be retrieved. Strings are not converted to numbers.
+// A snapshot of the global table skips _G, _VERSION and loaded libraries, as Serializer::globals does.
+
+#ifndef __LUACONFIG_SNAPSHOT_HPP
+#define __LUACONFIG_SNAPSHOT_HPP
+
+#include "core.hpp"
+#include "load.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace luaconfig {
+
+// ============================================================================
+// Storage
+
+enum SnapshotType : std::uint32_t {
+    snapshot_nil = 0,
+    snapshot_boolean,
+    snapshot_integer,
+    snapshot_number,
+    snapshot_string,
+    snapshot_table,
+    snapshot_function,
+    snapshot_other
+};
+
+struct SnapshotNode {
+    std::uint32_t type;
+    std::uint32_t size;   // string length, or number of table entries
+    std::uint32_t first;  // string offset, or index of first table entry
+    std::uint32_t length; // table length, as given by the # operator
+    std::uint64_t value;  // boolean, integer, or bits of number
+    std::uint64_t hash;   // of type and value, including contents of tables
+};
+
+// Neither record contains padding, so saved images are identical for identical configs
+static_assert(sizeof(SnapshotNode) == 4*sizeof(std::uint32_t) + 2*sizeof(std::uint64_t), "SnapshotNode must not contain padding");
+
+struct SnapshotEntry {
+    std::int64_t index;     // integer key
+    std::uint32_t key;      // string key offset
+    std::uint32_t key_size; // string key length
+    std::uint32_t node;     // value
+    std::uint32_t is_index; // 1 for integer keys, 0 for string keys
+};
+
+static_assert(sizeof(SnapshotEntry) == sizeof(std::int64_t) + 4*sizeof(std::uint32_t), "SnapshotEntry must not contain padding");
+
+// Pointers to the three arrays, wherever they happen to be stored
+struct SnapshotView {
+    const SnapshotNode* nodes;
+    const SnapshotEntry* entries;
+    const char* strings;
+    std::size_t n_nodes;
+    std::size_t n_entries;
+    std::size_t n_strings;
+};
+
+// Storage owned by a Snapshot built from Lua
+struct SnapshotData {
+    std::vector<SnapshotNode> nodes;
+    std::vector<SnapshotEntry> entries;
+    std::vector<char> strings;
+
+    SnapshotView view() const {
+        return SnapshotView{ nodes.data(), entries.data(), strings.data(), nodes.size(), entries.size(), strings.size()};
+    }
+};
+
+// ============================================================================
+// Hashing
+
+inline std::uint64_t snapshot_mix( std::uint64_t x){
+    // splitmix64 finaliser
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+inline std::uint64_t snapshot_combine( std::uint64_t h, std::uint64_t x){
+    return snapshot_mix(h ^ (x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)));
+}
+
+// ============================================================================
+// Building from Lua
+
+class SnapshotBuilder
+{
+    lua_State* _L;
+    SnapshotData& _data;
+    std::unordered_map<std::string,std::uint32_t> _interned;
+    std::unordered_map<const void*,std::uint32_t> _visited;
+
+    public:
+
+    SnapshotBuilder( lua_State* L, SnapshotData& data) : _L(L), _data(data) {}
+
+    // Add string to pool, return offset
+    std::uint32_t intern( const char* str, std::size_t len){
+        std::string key(str,len);
+        auto it = _interned.find(key);
+        if( it != _interned.end() ) return it->second;
+        std::uint32_t offset = static_cast<std::uint32_t>(_data.strings.size());
+        _data.strings.insert(_data.strings.end(),str,str+len);
+        _data.strings.push_back('\0');
+        _interned.emplace(std::move(key),offset);
+        return offset;
+    }
+
+    // Add value on top of stack, return node index
+    // Tables already visited are not added again, so shared and cyclic tables are handled.
+    std::uint32_t add( ){
+        SnapshotNode node{ snapshot_other, 0, 0, 0, 0, 0};
+        std::uint64_t content = 0;
+        switch( lua_type(_L,-1) ){
+            case LUA_TBOOLEAN:
+                node.type = snapshot_boolean;
+                node.value = lua_toboolean(_L,-1);
+                break;
+            case LUA_TNUMBER:
+                if( lua_isinteger(_L,-1) ){
+                    node.type = snapshot_integer;
+                    lua_Integer i = lua_tointeger(_L,-1);
+                    std::memcpy(&node.value,&i,sizeof(i));
+                } else {
+                    node.type = snapshot_number;
+                    double d = lua_tonumber(_L,-1);
+                    std::memcpy(&node.value,&d,sizeof(d));
+                }
+                break;
+            case LUA_TSTRING: {
+                std::size_t len;
+                const char* str = lua_tolstring(_L,-1,&len);
+                node.type = snapshot_string;
+                node.first = intern(str,len);
+                node.size = static_cast<std::uint32_t>(len);
+                content = fnv1a(str,len);
+                break;
+            }
+            case LUA_TTABLE:
+                return add_table(false);
+            case LUA_TFUNCTION:
+                node.type = snapshot_function;
+                content = function_hash();
+                break;
+            case LUA_TNIL:
+                node.type = snapshot_nil;
+                break;
+        }
+        node.hash = snapshot_combine(snapshot_combine(node.type,node.value),content);
+        _data.nodes.push_back(node);
+        return static_cast<std::uint32_t>(_data.nodes.size()-1);
+    }
+
+    // Add global table on top of stack, return node index
+    // As in Serializer::globals, _G, _VERSION, other references to the global table, and the
+    // standard libraries and anything else loaded by require are skipped.
+    std::uint32_t add_globals(){
+        return add_table(true);
+    }
+
+    private:
+
+    static int hash_writer( lua_State*, const void* p, std::size_t size, void* ud){
+        std::uint64_t& h = *static_cast<std::uint64_t*>(ud);
+        h = snapshot_combine(h,fnv1a(static_cast<const char*>(p),size));
+        return 0;
+    }
+
+    // Lua functions are hashed by their stripped bytecode, so that the same source gives the same
+    // hash in any Lua State. Upvalues are not included. C functions are hashed by address.
+    std::uint64_t function_hash(){
+        if( lua_iscfunction(_L,-1) ){
+            return static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(lua_tocfunction(_L,-1)));
+        }
+        std::uint64_t h = 0;
+        lua_dump(_L,&hash_writer,&h,1);
+        return h;
+    }
+
+    static bool entry_less( const std::vector<char>& strings, const SnapshotEntry& a, const SnapshotEntry& b){
+        if( a.is_index != b.is_index ) return a.is_index > b.is_index;
+        if( a.is_index ) return a.index < b.index;
+        return compare_key(strings.data()+a.key,a.key_size,strings.data()+b.key,b.key_size) < 0;
+    }
+
+    // Whether the field with key at -2 and value at -1 of the global table t is skipped
+    bool skip_global( int t, int loaded){
+        if( lua_rawequal(_L,-1,t) ) return true;
+        if( lua_type(_L,-2) != LUA_TSTRING ) return false;
+        const char* key = lua_tostring(_L,-2);
+        if( std::strcmp(key,"_G") == 0 || std::strcmp(key,"_VERSION") == 0 ) return true;
+        if( !lua_istable(_L,loaded) ) return false;
+        lua_pushvalue(_L,-2);
+        lua_rawget(_L,loaded);
+        bool library = lua_rawequal(_L,-1,-2);
+        lua_pop(_L,1);
+        return library;
+    }
+
+    std::uint32_t add_table( bool global){
+        const void* ptr = lua_topointer(_L,-1);
+        auto it = _visited.find(ptr);
+        if( it != _visited.end() ) return it->second;
+        // Reserve node before visiting children, so that cycles refer back to it
+        std::uint32_t id = static_cast<std::uint32_t>(_data.nodes.size());
+        _data.nodes.push_back( SnapshotNode{ snapshot_table, 0, 0, static_cast<std::uint32_t>(lua_rawlen(_L,-1)), 0, 0});
+        _visited.emplace(ptr,id);
+        if( !lua_checkstack(_L,4) ) throw std::runtime_error("luaconfig: table nesting too deep to snapshot");
+        int t = lua_gettop(_L);
+        int loaded = 0;
+        if( global ){
+            lua_getfield(_L,LUA_REGISTRYINDEX,"_LOADED");
+            loaded = lua_gettop(_L);
+        }
+        // Collect entries. Keys other than integers and strings are skipped.
+        std::vector<SnapshotEntry> entries;
+        lua_pushnil(_L);
+        while( lua_next(_L,t) ){
+            SnapshotEntry entry{ 0, 0, 0, 0, 0};
+            bool keep = true;
+            if( global && skip_global(t,loaded) ){
+                keep = false;
+            } else if( lua_type(_L,-2) == LUA_TNUMBER && lua_isinteger(_L,-2) ){
+                entry.is_index = 1;
+                entry.index = lua_tointeger(_L,-2);
+            } else if( lua_type(_L,-2) == LUA_TSTRING ){
+                std::size_t len;
+                const char* str = lua_tolstring(_L,-2,&len);
+                entry.key = intern(str,len);
+                entry.key_size = static_cast<std::uint32_t>(len);
+            } else {
+                keep = false;
+            }
+            if( keep ){
+                entry.node = add();
+                entries.push_back(entry);
+            }
+            lua_pop(_L,1);
+        }
+        if( global ) lua_pop(_L,1);
+        // Sort and store
+        const std::vector<char>& strings = _data.strings;
+        std::sort(entries.begin(),entries.end(),[&strings]( const SnapshotEntry& a, const SnapshotEntry& b){
+            return entry_less(strings,a,b);
+        });
+        _data.nodes[id].first = static_cast<std::uint32_t>(_data.entries.size());
+        _data.nodes[id].size = static_cast<std::uint32_t>(entries.size());
+        _data.entries.insert(_data.entries.end(),entries.begin(),entries.end());
+        // Hash entries in order. A table reached again through a cycle has no hash yet, and contributes
+        // only its type.
+        std::uint64_t h = snapshot_combine(snapshot_table,_data.nodes[id].length);
+        for( auto&& e : entries){
+            h = snapshot_combine(h, e.is_index ? static_cast<std::uint64_t>(e.index) : fnv1a(strings.data()+e.key,e.key_size));
+            h = snapshot_combine(h,_data.nodes[e.node].hash);
+        }
+        _data.nodes[id].hash = h;
+        return id;
+    }
+
+    public:
+
+    // Order string keys by bytes, then by length
+    static int compare_key( const char* a, std::size_t a_len, const char* b, std::size_t b_len){
+        int cmp = std::memcmp(a,b,std::min(a_len,b_len));
+        if( cmp != 0 ) return cmp;
+        return (a_len < b_len) ? -1 : (a_len > b_len);
+    }
+};
+
+// ============================================================================
+// Binary image
+// A header followed by the nodes, entries and strings, each starting on an 8-byte boundary. The
+// arrays are stored exactly as in memory, so are only readable on machines of the same byte order
+// and type sizes, which the header records.
+
+struct SnapshotImageHeader {
+    char magic[8];              // "LUACFGIM"
+    std::uint32_t version;
+    std::uint32_t byte_order;   // 0x01020304, as written
+    std::uint32_t node_size;
+    std::uint32_t entry_size;
+    std::uint32_t root;
+    std::uint32_t flags;        // snapshot_image_global if root is the global table
+    std::uint64_t n_nodes;
+    std::uint64_t n_entries;
+    std::uint64_t n_strings;
+    std::uint64_t nodes_offset;
+    std::uint64_t entries_offset;
+    std::uint64_t strings_offset;
+};
+
+static const char snapshot_image_magic[8] = {'L','U','A','C','F','G','I','M'};
+static const std::uint32_t snapshot_image_version = 1;
+static const std::uint32_t snapshot_image_global = 1;
+
+inline std::uint64_t snapshot_image_align( std::uint64_t offset){
+    return (offset + 7) & ~std::uint64_t(7);
+}
+
+// Mapped image, checked against the header
+class SnapshotImage
+{
+    MappedFile _file;
+    SnapshotView _view;
+    std::uint32_t _root;
+    bool _global;
+
+    [[noreturn]] static void fail( const char* filename, const char* problem){
+        throw FileException((std::string("invalid snapshot image ") + filename + ": " + problem).c_str());
+    }
+
+    bool in_file( std::uint64_t offset, std::uint64_t count, std::uint64_t size) const {
+        return offset % 8 == 0 && offset <= _file.size() && count <= (_file.size()-offset)/size;
+    }
+
+    public:
+
+    SnapshotImage( const char* filename, bool verify) : _file(filename) {
+        SnapshotImageHeader h;
+        if( _file.size() < sizeof(h) ) fail(filename,"too short");
+        std::memcpy(&h,_file.data(),sizeof(h));
+        if( std::memcmp(h.magic,snapshot_image_magic,sizeof(h.magic)) != 0 ) fail(filename,"not a snapshot image");
+        if( h.version != snapshot_image_version ) fail(filename,"unsupported version");
+        if( h.byte_order != 0x01020304 || h.node_size != sizeof(SnapshotNode) || h.entry_size != sizeof(SnapshotEntry) ){
+            fail(filename,"written on an incompatible machine");
+        }
+        if( !in_file(h.nodes_offset,h.n_nodes,sizeof(SnapshotNode))
+         || !in_file(h.entries_offset,h.n_entries,sizeof(SnapshotEntry))
+         || !in_file(h.strings_offset,h.n_strings,1)
+         || h.root >= h.n_nodes || (h.n_strings != 0 && _file.data()[h.strings_offset+h.n_strings-1] != '\0') ){
+            fail(filename,"truncated or corrupt");
+        }
+        _view.nodes = reinterpret_cast<const SnapshotNode*>(_file.data()+h.nodes_offset);
+        _view.entries = reinterpret_cast<const SnapshotEntry*>(_file.data()+h.entries_offset);
+        _view.strings = _file.data()+h.strings_offset;
+        _view.n_nodes = h.n_nodes;
+        _view.n_entries = h.n_entries;
+        _view.n_strings = h.n_strings;
+        _root = h.root;
+        _global = (h.flags & snapshot_image_global) != 0;
+        if( verify && !valid() ) fail(filename,"corrupt");
+    }
+
+    // Check every index in the image lies within bounds
+    // Table lengths are not indices and are not bounded, as a table with holes may be longer than
+    // its entries. Nothing is allocated according to a length alone.
+    bool valid() const {
+        for( std::size_t i=0; i<_view.n_nodes; ++i){
+            const SnapshotNode& n = _view.nodes[i];
+            if( n.type == snapshot_string && (n.first >= _view.n_strings || n.size >= _view.n_strings-n.first) ) return false;
+            if( n.type == snapshot_table && (n.first > _view.n_entries || n.size > _view.n_entries-n.first) ) return false;
+        }
+        for( std::size_t i=0; i<_view.n_entries; ++i){
+            const SnapshotEntry& e = _view.entries[i];
+            if( e.node >= _view.n_nodes ) return false;
+            if( !e.is_index && (e.key >= _view.n_strings || e.key_size >= _view.n_strings-e.key) ) return false;
+        }
+        return true;
+    }
+
+    const SnapshotView& view() const { return _view; }
+    std::uint32_t root() const { return _root; }
+    bool global() const { return _global; }
+};
+
+// ============================================================================
+// Snapshot class
+
+class Snapshot
+{
+    private:
+
+    std::shared_ptr<const void> _owner; // Keeps storage alive
+    SnapshotView _view;
+    std::uint32_t _root;
+    bool _global;                       // Root is the global table, so first tokens are text
+
+    public:
+
+    // ====================================================
+    // Constructors
+
+    // Take snapshot of table on top of stack. The table is not popped.
+    // A Snapshot of the global table treats the first token of each key as text, as Config does.
+    explicit Snapshot( lua_State* L, bool global = false) : _global(global) {
+        std::shared_ptr<SnapshotData> data = std::make_shared<SnapshotData>();
+        SnapshotBuilder builder(L,*data);
+        _root = global ? builder.add_globals() : builder.add();
+        _view = data->view();
+        _owner = std::move(data);
+    }
+
+    // View of existing storage
+    Snapshot( std::shared_ptr<const void> owner, SnapshotView view, std::uint32_t root, bool global = false) :
+        _owner(std::move(owner)), _view(view), _root(root), _global(global) {}
+
+    // ====================================================
+    // Lookup and return value
+
+    // throwing version
+    template<class T>
+    T get( const char* key) const {
+        std::uint32_t node = lookup(key);
+        type_test<T>(node,key);
+        return convert<T>(node);
+    }
+
+    template<class T>
+    T get( const std::string& key) const {
+        return get<T>(key.c_str());
+    }
+
+    template<class T>
+    T get( const Path& key) const {
+        std::uint32_t node = lookup(key);
+        type_test<T>(node,key.c_str());
+        return convert<T>(node);
+    }
+
+    template<class T>
+    T get( int key) const {
+        std::uint32_t node = lookup_index(_root,key);
+        type_test<T>(node,key);
+        return convert<T>(node);
+    }
+
+    // non-throwing version with default
+    template<class T>
+    T get( const char* key, T def) const {
+        std::uint32_t node = lookup(key);
+        return convertible<T>(node) ? convert<T>(node) : def;
+    }
+
+    template<class T>
+    T get( const std::string& key, T def) const {
+        return get<T>(key.c_str(),def);
+    }
+
+    template<class T>
+    T get( const Path& key, T def) const {
+        std::uint32_t node = lookup(key);
+        return convertible<T>(node) ? convert<T>(node) : def;
+    }
+
+    template<class T>
+    T get( int key, T def) const {
+        std::uint32_t node = lookup_index(_root,key);
+        return convertible<T>(node) ? convert<T>(node) : def;
+    }
+
+    // ====================================================
+    // Test existance of value
+
+    bool exists( const char* key) const {
+        return lookup(key) != not_found;
+    }
+
+    bool exists( const std::string& key) const {
+        return exists(key.c_str());
+    }
+
+    bool exists( const Path& key) const {
+        return lookup(key) != not_found;
+    }
+
+    bool exists( int key) const {
+        return lookup_index(_root,key) != not_found;
+    }
+
+    // ====================================================
+    // Get length of table
+    // Returns 0 for anything other than tables and strings
+
+    std::size_t len() const {
+        return node_len(_root);
+    }
+
+    std::size_t len( const char* key) const {
+        return node_len(lookup(key));
+    }
+
+    std::size_t len( const std::string& key) const {
+        return len(key.c_str());
+    }
+
+    std::size_t len( const Path& key) const {
+        return node_len(lookup(key));
+    }
+
+    std::size_t len( int key) const {
+        return node_len(lookup_index(_root,key));
+    }
+
+    // ====================================================
+    // Raw access to storage
+
+    const SnapshotView& view() const { return _view; }
+    std::uint32_t root() const { return _root; }
+
+    // Hash of entire contents. Equal snapshots have equal hashes.
+    std::uint64_t hash() const { return _view.nodes[_root].hash; }
+
+    // ====================================================
+    // Binary images
+
+    // Save as image
+    // The file is written under a temporary name and then renamed, so processes that map it never
+    // see it half-written. All of the storage is saved, even for a Snapshot of a nested table.
+    void save( const char* filename) const {
+        SnapshotImageHeader h;
+        std::memset(&h,0,sizeof(h));
+        std::memcpy(h.magic,snapshot_image_magic,sizeof(h.magic));
+        h.version = snapshot_image_version;
+        h.byte_order = 0x01020304;
+        h.node_size = sizeof(SnapshotNode);
+        h.entry_size = sizeof(SnapshotEntry);
+        h.root = _root;
+        h.flags = _global ? snapshot_image_global : 0;
+        h.n_nodes = _view.n_nodes;
+        h.n_entries = _view.n_entries;
+        h.n_strings = _view.n_strings;
+        h.nodes_offset = snapshot_image_align(sizeof(h));
+        h.entries_offset = snapshot_image_align(h.nodes_offset + h.n_nodes*sizeof(SnapshotNode));
+        h.strings_offset = snapshot_image_align(h.entries_offset + h.n_entries*sizeof(SnapshotEntry));
+        std::string tmp = std::string(filename) + ".tmp";
+        std::FILE* file = std::fopen(tmp.c_str(),"wb");
+        if( file == nullptr ) throw FileException((std::string("cannot open ") + tmp + ": " + std::strerror(errno)).c_str());
+        static const char padding[8] = {0};
+        std::uint64_t pos = 0;
+        bool ok = true;
+        auto put = [&]( std::uint64_t offset, const void* data, std::uint64_t size){
+            ok = ok && std::fwrite(padding,1,offset-pos,file) == offset-pos;
+            ok = ok && (size == 0 || std::fwrite(data,1,size,file) == size);
+            pos = offset + size;
+        };
+        put(0,&h,sizeof(h));
+        put(h.nodes_offset,_view.nodes,h.n_nodes*sizeof(SnapshotNode));
+        put(h.entries_offset,_view.entries,h.n_entries*sizeof(SnapshotEntry));
+        put(h.strings_offset,_view.strings,h.n_strings);
+        ok = (std::fclose(file) == 0) && ok;
+        if( !ok || std::rename(tmp.c_str(),filename) != 0 ){
+            int err = errno;
+            std::remove(tmp.c_str());
+            throw FileException((std::string("cannot write ") + filename + ": " + std::strerror(err)).c_str());
+        }
+    }
+
+    void save( const std::string& filename) const {
+        save(filename.c_str());
+    }
+
+    // Map image read-only
+    // Only the header and section bounds are checked unless verify is set, in which case every
+    // node and entry is checked, at the cost of reading the whole image. Images from untrusted
+    // sources should be verified.
+    static Snapshot map( const char* filename, bool verify = false){
+        std::shared_ptr<SnapshotImage> image = std::make_shared<SnapshotImage>(filename,verify);
+        return Snapshot(image,image->view(),image->root(),image->global());
+    }
+
+    static Snapshot map( const std::string& filename, bool verify = false){
+        return map(filename.c_str(),verify);
+    }
+
+    private:
+
+    enum : std::uint32_t { not_found = 0xFFFFFFFF };
+
+    const SnapshotNode& node( std::uint32_t id) const { return _view.nodes[id]; }
+
+    // ====================================================
+    // Lookups
+
+    std::uint32_t lookup_index( std::uint32_t table, lua_Integer index) const {
+        if( table == not_found || node(table).type != snapshot_table ) return not_found;
+        const SnapshotEntry* first = _view.entries + node(table).first;
+        const SnapshotEntry* last = first + node(table).size;
+        const SnapshotEntry* it = std::lower_bound(first,last,index,[]( const SnapshotEntry& e, lua_Integer i){
+            return e.is_index && e.index < i;
+        });
+        return ( it != last && it->is_index && it->index == index ) ? it->node : not_found;
+    }
+
+    std::uint32_t lookup_key( std::uint32_t table, const char* key, std::size_t len) const {
+        if( table == not_found || node(table).type != snapshot_table ) return not_found;
+        const SnapshotEntry* first = _view.entries + node(table).first;
+        const SnapshotEntry* last = first + node(table).size;
+        const char* strings = _view.strings;
+        const SnapshotEntry* it = std::lower_bound(first,last,0,[&]( const SnapshotEntry& e, int){
+            return e.is_index || SnapshotBuilder::compare_key(strings+e.key,e.key_size,key,len) < 0;
+        });
+        return ( it != last && !it->is_index && it->key_size == len && std::memcmp(strings+it->key,key,len) == 0 ) ? it->node : not_found;
+    }
+
+    std::uint32_t lookup( const char* key) const {
+        const char* p = key;
+        const char* tk;
+        std::size_t len;
+        std::uint32_t current = _root;
+        bool text = _global;
+        while( current != not_found && next_token(p,tk,len) ){
+            current = ( token_is_index(tk) && !text ) ? lookup_index(current,token_to_index(tk,len)) : lookup_key(current,tk,len);
+            text = false;
+        }
+        return current;
+    }
+
+    std::uint32_t lookup( const Path& path) const {
+        std::uint32_t current = _root;
+        for( auto it = path.begin(); current != not_found && it != path.end(); ++it){
+            bool text = _global && it == path.begin();
+            current = ( it->is_index && !text ) ? lookup_index(current,it->index) : lookup_key(current,it->key.data(),it->key.size());
+        }
+        return current;
+    }
+
+    std::size_t node_len( std::uint32_t id) const {
+        if( id == not_found ) return 0;
+        if( node(id).type == snapshot_table ) return node(id).length;
+        if( node(id).type == snapshot_string ) return node(id).size;
+        return 0;
+    }
+
+    // ====================================================
+    // Type checking
+
+    std::uint32_t type_of( std::uint32_t id) const {
+        return ( id == not_found ) ? snapshot_nil : node(id).type;
+    }
+
+    static const char* type_name( std::uint32_t type){
+        switch(type){
+            case snapshot_boolean: return "boolean";
+            case snapshot_integer: return "number";
+            case snapshot_number: return "number";
+            case snapshot_string: return "string";
+            case snapshot_table: return "table";
+            case snapshot_function: return "function";
+            case snapshot_other: return "userdata";
+            default: return "nil";
+        }
+    }
+
+    // float
+    template<class T>
+    auto is_type( std::uint32_t id) const
+        -> typename std::enable_if< std::is_floating_point<T>::value, bool>::type
+    {
+        return type_of(id) == snapshot_number || type_of(id) == snapshot_integer;
+    }
+
+    // integer
+    template<class T>
+    auto is_type( std::uint32_t id) const
+        -> typename std::enable_if< std::is_integral<T>::value && !std::is_same<T,bool>::value, bool>::type
+    {
+        return type_of(id) == snapshot_integer;
+    }
+
+    // boolean
+    template<class T>
+    auto is_type( std::uint32_t id) const
+        -> typename std::enable_if< std::is_same<T,bool>::value, bool>::type
+    {
+        return type_of(id) == snapshot_boolean;
+    }
+
+    // string
+    template<class T>
+    auto is_type( std::uint32_t id) const
+        -> typename std::enable_if< std::is_same<T,std::string>::value, bool>::type
+    {
+        return type_of(id) == snapshot_string || type_of(id) == snapshot_integer || type_of(id) == snapshot_number;
+    }
+
+    // table (Snapshot or std::vector)
+    template<class T>
+    auto is_type( std::uint32_t id) const
+        -> typename std::enable_if< std::is_same<T,Snapshot>::value || is_vector<T>::value, bool>::type
+    {
+        return type_of(id) == snapshot_table;
+    }
+
+    // Can the value be converted without throwing? Unlike is_type, checks the elements of arrays.
+    template<class T>
+    auto convertible( std::uint32_t id) const
+        -> typename std::enable_if< !is_vector<T>::value, bool>::type
+    {
+        return is_type<T>(id);
+    }
+
+    template<class T>
+    auto convertible( std::uint32_t id) const
+        -> typename std::enable_if< is_vector<T>::value, bool>::type
+    {
+        using E = typename is_vector<T>::element;
+        if( !is_type<T>(id) ) return false;
+        for( std::uint32_t i=0; i<node(id).length; ++i){
+            if( !convertible<E>(lookup_index(id,static_cast<lua_Integer>(i+1))) ) return false;
+        }
+        return true;
+    }
+
+    template<class T, class K>
+    void type_test( std::uint32_t id, K key) const {
+        if( !is_type<T>(id) ) throw TypeMismatchException(key,requested_name<T>(),type_name(type_of(id)));
+    }
+
+    template<class T>
+    static auto requested_name()
+        -> typename std::enable_if< std::is_floating_point<T>::value, const char*>::type { return "number"; }
+
+    template<class T>
+    static auto requested_name()
+        -> typename std::enable_if< std::is_integral<T>::value && !std::is_same<T,bool>::value, const char*>::type { return "number (integer)"; }
+
+    template<class T>
+    static auto requested_name()
+        -> typename std::enable_if< std::is_same<T,bool>::value, const char*>::type { return "boolean"; }
+
+    template<class T>
+    static auto requested_name()
+        -> typename std::enable_if< std::is_same<T,std::string>::value, const char*>::type { return "string"; }
+
+    template<class T>
+    static auto requested_name()
+        -> typename std::enable_if< std::is_same<T,Snapshot>::value, const char*>::type { return "table (as luaconfig Snapshot)"; }
+
+    template<class T>
+    static auto requested_name()
+        -> typename std::enable_if< is_vector<T>::value, const char*>::type { return "table (as std::vector)"; }
+
+    // ====================================================
+    // Conversion
+
+    lua_Integer as_integer( std::uint32_t id) const {
+        lua_Integer i;
+        std::memcpy(&i,&node(id).value,sizeof(i));
+        return i;
+    }
+
+    double as_number( std::uint32_t id) const {
+        if( node(id).type == snapshot_integer ) return static_cast<double>(as_integer(id));
+        double d;
+        std::memcpy(&d,&node(id).value,sizeof(d));
+        return d;
+    }
+
+    // float
+    template<class T>
+    auto convert( std::uint32_t id) const
+        -> typename std::enable_if< std::is_floating_point<T>::value, T>::type
+    {
+        return static_cast<T>(as_number(id));
+    }
+
+    // integer
+    template<class T>
+    auto convert( std::uint32_t id) const
+        -> typename std::enable_if< std::is_integral<T>::value && !std::is_same<T,bool>::value, T>::type
+    {
+        return static_cast<T>(as_integer(id));
+    }
+
+    // boolean
+    template<class T>
+    auto convert( std::uint32_t id) const
+        -> typename std::enable_if< std::is_same<T,bool>::value, T>::type
+    {
+        return node(id).value != 0;
+    }
+
+    // string
+    // Numbers are formatted as by Lua's tostring
+    template<class T>
+    auto convert( std::uint32_t id) const
+        -> typename std::enable_if< std::is_same<T,std::string>::value, T>::type
+    {
+        char buffer[64];
+        switch( node(id).type ){
+            case snapshot_integer:
+                std::snprintf(buffer,sizeof(buffer),"%" PRId64,static_cast<std::int64_t>(as_integer(id)));
+                return std::string(buffer);
+            case snapshot_number:
+                std::snprintf(buffer,sizeof(buffer),"%.14g",as_number(id));
+                if( buffer[std::strspn(buffer,"-0123456789")] == '\0' ) std::strcat(buffer,".0");
+                return std::string(buffer);
+            default:
+                return std::string(_view.strings + node(id).first, node(id).size);
+        }
+    }
+
+    // table (Snapshot)
+    template<class T>
+    auto convert( std::uint32_t id) const
+        -> typename std::enable_if< std::is_same<T,Snapshot>::value, T>::type
+    {
+        return Snapshot(_owner,_view,id);
+    }
+
+    // array (std::vector)
+    template<class T>
+    auto convert( std::uint32_t id) const
+        -> typename std::enable_if< is_vector<T>::value, T>::type
+    {
+        using E = typename is_vector<T>::element;
+        // A table holds at most size elements, so a length beyond that, as in a table with holes or a
+        // corrupt image, fails on a missing element rather than allocating up front
+        std::uint32_t n = node(id).length;
+        T result;
+        result.reserve(std::min(n,node(id).size));
+        for( std::uint32_t i=0; i<n; ++i){
+            std::uint32_t element = lookup_index(id,static_cast<lua_Integer>(i+1));
+            type_test<E>(element,static_cast<int>(i+1));
+            result.push_back(convert<E>(element));
+        }
+        return result;
+    }
+};
+
+} // end namespace
+#endif
@@ -0,0 +1,231 @@
+// TableIterator.hpp
+//
+// Iteration over the entries of a Lua table.
+//
+// Setting::pairs() visits every key/value pair using lua_next, in no particular order, while
+// Setting::ipairs() visits elements 1,2,3... using raw array access, stopping at the first nil.
+// Each iteration reserves a registry slot for the table, the current key and the current value
+// when it begins. Advancing reuses these slots, so it allocates nothing, creates no threads, and
+// costs a handful of Lua API calls per element.
+//
+//     for( auto&& entry : setting.pairs()){
+//         if( entry.key() ) std::cout << entry.key() << " = " << entry.as<double>(0.0) << '\n';
+//     }
+//
+// Entries refer to the iteration that produced them, and are only valid until it is advanced.
+
+#ifndef __LUACONFIG_TABLEITERATOR_HPP
+#define __LUACONFIG_TABLEITERATOR_HPP
+
+#include "core.hpp"
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <string>
+
+namespace luaconfig {
+
+// ============================================================================
+// Entry: current key and value of an iteration
+
+class Entry
+{
+    friend class TableIterator;
+
+    lua_State* _L;
+    int _value_ref;
+    int _key_type;        // Lua type of key
+    lua_Integer _index;   // Integer key, if has_index()
+    bool _has_index;
+    const char* _key;     // String key, or nullptr
+    std::size_t _key_size;
+
+    Entry( lua_State* L, int value_ref) :
+        _L(L), _value_ref(value_ref), _key_type(LUA_TNIL), _index(0), _has_index(false), _key(nullptr), _key_size(0) {}
+
+    public:
+
+    // ====================================================
+    // Key
+    // String keys are held in the registry for the duration of the step, so no copy is made.
+
+    int key_type() const { return _key_type; }
+
+    bool has_index() const { return _has_index; }
+    lua_Integer index() const { return _index; }
+
+    const char* key() const { return _key; }
+    std::size_t key_size() const { return _key_size; }
+
+    // Key as text, with integer keys written in decimal
+    std::string key_str() const {
+        if( _key != nullptr ) return std::string(_key,_key_size);
+        if( _has_index ) return std::to_string(_index);
+        return std::string();
+    }
+
+    // ====================================================
+    // Value
+
+    template<class T>
+    bool is() const {
+        RefGuard guard(_L,_value_ref);
+        return is_type<T>(_L);
+    }
+
+    // throwing version
+    template<class T>
+    T as() const {
+        RefGuard guard(_L,_value_ref);
+        if( _key != nullptr ){
+            type_test<T>(_L,_key);
+            return value_to_cpp<T>(_L,_key);
+        }
+        type_test<T>(_L,static_cast<int>(_index));
+        return value_to_cpp<T>(_L,static_cast<int>(_index));
+    }
+
+    // non-throwing version with default
+    template<class T>
+    T as( T def) const {
+        RefGuard guard(_L,_value_ref);
+        T result;
+        if( try_stack_to_cpp(_L,result) ) return result;
+        LUACONFIG_COUNT_DEFAULT(_L);
+        return def;
+    }
+};
+
+// ============================================================================
+// Iterator
+// Iterators share the state of their iteration, so copies advance together. The end iterator
+// holds no state.
+
+class TableIterator
+{
+    struct State
+    {
+        lua_State* L;
+        int table_ref;
+        int key_ref;
+        bool array;      // ipairs rather than pairs
+        bool started;
+        bool done;
+        Entry entry;
+
+        State( lua_State* L, int table, bool array) :
+            L(L), table_ref(copy_ref(L,table)), key_ref(reserve(L)), array(array), started(false), done(false), entry(L,reserve(L)) {}
+
+        ~State(){
+            free_ref(L,entry._value_ref);
+            free_ref(L,key_ref);
+            free_ref(L,table_ref);
+        }
+
+        State( const State&) = delete;
+        State& operator=( const State&) = delete;
+
+        // Create registry slot, to be overwritten later
+        static int reserve( lua_State* L){
+            lua_pushboolean(L,0);
+            return new_ref(L);
+        }
+    };
+
+    std::shared_ptr<State> _state;
+
+    bool at_end() const { return !_state || _state->done; }
+
+    // Step using lua_next
+    void next_pair(){
+        State& s = *_state;
+        // Side notes follow stack. t=table, k=key, v=value
+        RefGuard guard(s.L,s.table_ref);                 // +1, [t]
+        if( s.started ) push_ref(s.L,s.key_ref);         // +2, [t,k]
+        else lua_pushnil(s.L);
+        s.started = true;
+        if( !lua_next(s.L,-2) ){                         // +3, [t,k,v], or +1, [t] at end
+            s.done = true;
+            return;
+        }
+        replace_ref(s.L,s.entry._value_ref);             // +2, [t,k]
+        Entry& e = s.entry;
+        e._key_type = lua_type(s.L,-1);
+        e._has_index = lua_isinteger(s.L,-1);
+        e._index = e._has_index ? lua_tointeger(s.L,-1) : 0;
+        // Strings may be read in place. Keys of other types must not be converted, as lua_next
+        // requires the original key.
+        e._key = ( e._key_type == LUA_TSTRING ) ? lua_tolstring(s.L,-1,&e._key_size) : nullptr;
+        if( e._key == nullptr ) e._key_size = 0;
+        replace_ref(s.L,s.key_ref);                      // +1, [t], key still referenced
+    }
+
+    // Step using raw array access
+    void next_index(){
+        State& s = *_state;
+        // Side notes follow stack. t=table, v=value
+        RefGuard guard(s.L,s.table_ref);                 // +1, [t]
+        lua_Integer i = s.entry._index + 1;
+        if( lua_rawgeti(s.L,-1,i) == LUA_TNIL ){         // +2, [t,v]
+            s.done = true;
+            return;
+        }
+        replace_ref(s.L,s.entry._value_ref);             // +1, [t]
+        s.entry._key_type = LUA_TNUMBER;
+        s.entry._has_index = true;
+        s.entry._index = i;
+    }
+
+    public:
+
+    using iterator_category = std::input_iterator_tag;
+    using value_type = Entry;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Entry*;
+    using reference = const Entry&;
+
+    // End iterator
+    TableIterator() {}
+
+    // Iterator at first entry of referenced table
+    TableIterator( lua_State* L, int table_ref, bool array) : _state(std::make_shared<State>(L,table_ref,array)) {
+        ++*this;
+    }
+
+    reference operator*() const { return _state->entry; }
+    pointer operator->() const { return &_state->entry; }
+
+    TableIterator& operator++(){
+        if( _state->array ) next_index();
+        else next_pair();
+        return *this;
+    }
+
+    bool operator==( const TableIterator& other) const {
+        if( at_end() || other.at_end() ) return at_end() && other.at_end();
+        return _state == other._state;
+    }
+
+    bool operator!=( const TableIterator& other) const { return !(*this == other); }
+};
+
+// ============================================================================
+// Views, for use with range-based for loops
+
+class TableView
+{
+    lua_State* _L;
+    int _ref;
+    bool _array;
+
+    public:
+
+    TableView( lua_State* L, int ref, bool array) : _L(L), _ref(ref), _array(array) {}
+
+    TableIterator begin() const { return TableIterator(_L,_ref,_array); }
+    TableIterator end() const { return TableIterator(); }
+};
+
+} // end namespace
+#endif
@@ -0,0 +1,377 @@
+// allocators.hpp
+//
+// Memory allocation policies for luaconfig.
+//
+// By default, a Config uses the same realloc-based allocator as the standalone Lua interpreter. An
+// Allocator may instead be passed to a Config on construction, in which case the Config takes
+// ownership of it and all memory used by its Lua State is requested through it. As a Lua State is
+// only used by one thread at a time, allocators need not be thread-safe.
+//
+// Whichever policy is used, the Allocator base class keeps count of the memory in use, the number of
+// registry references held by Setting and Function objects, and the number of completed garbage
+// collection cycles. These are reported by Config::memory_stats().
+//
+// The following policies are provided:
+//     MallocAllocator -- realloc/free, as used by luaL_newstate.
+//     PoolAllocator   -- small objects are served from free lists of fixed size classes, carved out
+//                        of large blocks. Reduces fragmentation and contention with the rest of the
+//                        program. Larger objects fall back to malloc.
+//     ArenaAllocator  -- bump allocation from large blocks, which are only released when the Config
+//                        is destroyed. Best suited to configs that are loaded once and then only read.
+//     BudgetAllocator -- wraps another allocator, and refuses any allocation that would take the
+//                        total in use past a fixed limit. Lua reports this as a memory error, which
+//                        luaconfig raises as a MemoryException.
+//
+// Note that the Lua API only reports memory errors within protected calls, such as loading a file or
+// calling a Function. Elsewhere, such as when creating new strings during get/set, Lua will panic.
+
+#ifndef __LUACONFIG_ALLOCATORS_HPP
+#define __LUACONFIG_ALLOCATORS_HPP
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace luaconfig {
+
+// ============================================================================
+// Allocator interface
+// reallocate follows the contract of lua_Alloc: a new size of zero frees ptr and returns nullptr,
+// ptr is nullptr for new allocations (in which case osize is not a size), and nullptr is returned
+// on failure.
+
+class Allocator
+{
+    std::size_t _bytes = 0;       // Bytes currently allocated
+    std::size_t _peak = 0;        // Maximum of _bytes
+    std::size_t _allocations = 0; // Number of new allocations
+    std::size_t _handles = 0;     // Registry references held by Settings and Functions
+    std::size_t _gc_cycles = 0;   // Completed garbage collection cycles
+
+    public:
+
+    virtual ~Allocator() {}
+
+    virtual void* reallocate( void* ptr, std::size_t osize, std::size_t nsize) = 0;
+
+    // lua_Alloc function, with the Allocator as its user data
+    // Counts every successful request on behalf of the policy.
+    static void* dispatch( void* ud, void* ptr, std::size_t osize, std::size_t nsize){
+        Allocator* alloc = static_cast<Allocator*>(ud);
+        void* result = alloc->reallocate(ptr,osize,nsize);
+        if( result != nullptr || nsize == 0 ){
+            if( ptr != nullptr ) alloc->_bytes -= osize;
+            else if( nsize != 0 ) ++alloc->_allocations;
+            alloc->_bytes += nsize;
+            alloc->_peak = std::max(alloc->_peak,alloc->_bytes);
+        }
+        return result;
+    }
+
+    // Allocator of a Lua State, or nullptr if it was not created through one
+    static Allocator* of( lua_State* L){
+        void* ud;
+        return ( lua_getallocf(L,&ud) == &dispatch ) ? static_cast<Allocator*>(ud) : nullptr;
+    }
+
+    // Record creation/release of a Setting or Function handle
+    static void add_handle( lua_State* L){
+        if( Allocator* alloc = of(L) ) ++alloc->_handles;
+    }
+
+    static void remove_handle( lua_State* L){
+        if( Allocator* alloc = of(L) ) --alloc->_handles;
+    }
+
+    // Finalizer of the garbage collection sentinel
+    // The sentinel is unreachable from the moment it is created, so it is finalized at the end of
+    // the next cycle. Each time, it is replaced by a new one sharing the same metatable.
+    static int gc_sentinel( lua_State* L){
+        Allocator* alloc = static_cast<Allocator*>(lua_touserdata(L,lua_upvalueindex(1)));
+        ++alloc->_gc_cycles;
+        lua_newtable(L);                                 // +1, [s]
+        lua_getmetatable(L,1);                           // +2, [s,m]
+        lua_setmetatable(L,-2);                          // +1, [s], setmetatable(s,m)
+        return 0;
+    }
+
+    // Start counting garbage collection cycles
+    void arm_gc_sentinel( lua_State* L){
+        // Side notes follow stack. s=sentinel, m=metatable
+        lua_newtable(L);                                 // +1, [s]
+        lua_newtable(L);                                 // +2, [s,m]
+        lua_pushlightuserdata(L,this);                   // +3, [s,m,a]
+        lua_pushcclosure(L,&gc_sentinel,1);              // +3, [s,m,f]
+        lua_setfield(L,-2,"__gc");                       // +2, [s,m], m.__gc = f
+        lua_setmetatable(L,-2);                          // +1, [s], setmetatable(s,m)
+        lua_pop(L,1);                                    // +0, [], leave s to the collector
+    }
+
+    std::size_t bytes() const { return _bytes; }
+    std::size_t peak_bytes() const { return _peak; }
+    std::size_t allocations() const { return _allocations; }
+    std::size_t handles() const { return _handles; }
+    std::size_t gc_cycles() const { return _gc_cycles; }
+};
+
+// Summary of memory used by a Config
+struct MemoryStats
+{
+    std::size_t bytes;        // Bytes currently allocated
+    std::size_t peak_bytes;   // Most bytes allocated at any one time
+    std::size_t allocations;  // Total number of allocations made
+    std::size_t gc_bytes;     // Bytes in use according to the garbage collector
+    std::size_t live_handles; // Settings and Functions currently alive
+    std::size_t live_threads; // Threads currently handed out by the thread pool
+    std::size_t gc_cycles;    // Completed garbage collection cycles
+};
+
+// Panic function, as installed by luaL_newstate
+inline int panic( lua_State* L){
+    std::fprintf(stderr,"PANIC: unprotected error in call to Lua API (%s)\n",lua_tostring(L,-1));
+    std::fflush(stderr);
+    return 0;
+}
+
+// Create new Lua State using given allocator
+inline lua_State* new_state( Allocator& alloc){
+    lua_State* L = lua_newstate(&Allocator::dispatch,&alloc);
+    if( L == nullptr ) return L;
+    lua_atpanic(L,&panic);
+    // Lua leaves the extra space uninitialised. It is used to point to the key cache (keys.hpp).
+    *static_cast<void**>(lua_getextraspace(L)) = nullptr;
+    return L;
+}
+
+// ============================================================================
+// MallocAllocator
+
+class MallocAllocator : public Allocator
+{
+    public:
+
+    void* reallocate( void* ptr, std::size_t, std::size_t nsize) override {
+        if( nsize == 0 ){
+            std::free(ptr);
+            return nullptr;
+        }
+        return std::realloc(ptr,nsize);
+    }
+};
+
+// ============================================================================
+// PoolAllocator
+
+class PoolAllocator : public Allocator
+{
+    public:
+
+    static const std::size_t granularity = 16;        // size classes are multiples of this
+    static const std::size_t max_small = 512;         // larger objects use malloc
+    static const std::size_t block_size = 64*1024;    // size of blocks carved into objects
+
+    private:
+
+    struct FreeNode { FreeNode* next; };
+
+    FreeNode* _free[max_small/granularity];
+    std::vector<char*> _blocks;
+    char* _ptr;
+    char* _end;
+
+    static std::size_t size_class( std::size_t size){
+        return (size+granularity-1)/granularity - 1;
+    }
+
+    void* allocate( std::size_t size){
+        if( size > max_small ) return std::malloc(size);
+        std::size_t c = size_class(size);
+        if( _free[c] != nullptr ){
+            FreeNode* node = _free[c];
+            _free[c] = node->next;
+            return node;
+        }
+        std::size_t bytes = (c+1)*granularity;
+        if( static_cast<std::size_t>(_end-_ptr) < bytes ){
+            char* block = static_cast<char*>(std::malloc(block_size));
+            if( block == nullptr ) return nullptr;
+            _blocks.push_back(block);
+            _ptr = block;
+            _end = block + block_size;
+        }
+        void* result = _ptr;
+        _ptr += bytes;
+        return result;
+    }
+
+    void deallocate( void* ptr, std::size_t size){
+        if( ptr == nullptr ) return;
+        if( size > max_small ) return std::free(ptr);
+        FreeNode* node = static_cast<FreeNode*>(ptr);
+        std::size_t c = size_class(size);
+        node->next = _free[c];
+        _free[c] = node;
+    }
+
+    public:
+
+    PoolAllocator() : _ptr(nullptr), _end(nullptr) {
+        std::fill(std::begin(_free),std::end(_free),nullptr);
+    }
+
+    ~PoolAllocator(){
+        for( auto&& block : _blocks) std::free(block);
+    }
+
+    PoolAllocator( const PoolAllocator&) = delete;
+    PoolAllocator& operator=( const PoolAllocator&) = delete;
+
+    void* reallocate( void* ptr, std::size_t osize, std::size_t nsize) override {
+        if( nsize == 0 ){
+            if( ptr != nullptr ) deallocate(ptr,osize);
+            return nullptr;
+        }
+        if( ptr == nullptr ) return allocate(nsize);
+        // Stays within the same size class, or remains large
+        if( osize > max_small && nsize > max_small ) return std::realloc(ptr,nsize);
+        if( osize <= max_small && nsize <= max_small && size_class(osize) == size_class(nsize) ) return ptr;
+        // Moves between size classes
+        void* result = allocate(nsize);
+        if( result == nullptr ){
+            if( nsize > osize ) return nullptr;
+            // Lua assumes shrinking never fails, so keep the existing memory. A large object now
+            // counts as small, so may later join a free list. It is then released with the blocks,
+            // unless even recording it fails.
+            if( osize > max_small ){
+                try{ _blocks.push_back(static_cast<char*>(ptr)); } catch( const std::bad_alloc&) {}
+            }
+            return ptr;
+        }
+        std::memcpy(result,ptr,std::min(osize,nsize));
+        deallocate(ptr,osize);
+        return result;
+    }
+};
+
+// ============================================================================
+// ArenaAllocator
+
+class ArenaAllocator : public Allocator
+{
+    public:
+
+    static const std::size_t alignment = 16;
+    static const std::size_t default_block_size = 1024*1024;
+
+    private:
+
+    std::size_t _block_size;
+    std::vector<char*> _blocks;
+    char* _ptr;
+    char* _end;
+
+    static std::size_t round_up( std::size_t size){
+        return (size+alignment-1) & ~(alignment-1);
+    }
+
+    // Is ptr the most recent allocation?
+    bool is_last( void* ptr, std::size_t size) const {
+        return static_cast<char*>(ptr) + round_up(size) == _ptr;
+    }
+
+    void* allocate( std::size_t size){
+        size = round_up(size);
+        if( static_cast<std::size_t>(_end-_ptr) < size ){
+            std::size_t bytes = std::max(_block_size,size);
+            char* block = static_cast<char*>(std::malloc(bytes));
+            if( block == nullptr ) return nullptr;
+            _blocks.push_back(block);
+            _ptr = block;
+            _end = block + bytes;
+        }
+        void* result = _ptr;
+        _ptr += size;
+        return result;
+    }
+
+    public:
+
+    explicit ArenaAllocator( std::size_t block_size = default_block_size) :
+        _block_size(block_size), _ptr(nullptr), _end(nullptr) {}
+
+    ~ArenaAllocator(){
+        for( auto&& block : _blocks) std::free(block);
+    }
+
+    ArenaAllocator( const ArenaAllocator&) = delete;
+    ArenaAllocator& operator=( const ArenaAllocator&) = delete;
+
+    void* reallocate( void* ptr, std::size_t osize, std::size_t nsize) override {
+        if( ptr == nullptr ) return nsize ? allocate(nsize) : nullptr;
+        // The most recent allocation may be resized in place
+        if( is_last(ptr,osize) ){
+            char* start = static_cast<char*>(ptr);
+            if( nsize == 0 ){
+                _ptr = start;
+                return nullptr;
+            }
+            if( static_cast<std::size_t>(_end-start) >= round_up(nsize) ){
+                _ptr = start + round_up(nsize);
+                return ptr;
+            }
+        }
+        // Otherwise, freed memory is only reclaimed when the arena is destroyed
+        if( nsize == 0 ) return nullptr;
+        if( nsize <= osize ) return ptr;
+        void* result = allocate(nsize);
+        if( result != nullptr ) std::memcpy(result,ptr,osize);
+        return result;
+    }
+};
+
+// ============================================================================
+// BudgetAllocator
+
+class BudgetAllocator : public Allocator
+{
+    std::unique_ptr<Allocator> _inner;
+    std::size_t _limit;
+    std::size_t _used;
+    bool _exceeded;
+
+    public:
+
+    explicit BudgetAllocator( std::size_t limit, std::unique_ptr<Allocator> inner = std::unique_ptr<Allocator>(new MallocAllocator)) :
+        _inner(std::move(inner)), _limit(limit), _used(0), _exceeded(false) {}
+
+    void* reallocate( void* ptr, std::size_t osize, std::size_t nsize) override {
+        std::size_t old_size = ( ptr != nullptr ) ? osize : 0;
+        if( nsize > old_size && nsize - old_size > _limit - _used ){
+            _exceeded = true;
+            return nullptr;
+        }
+        void* result = _inner->reallocate(ptr,osize,nsize);
+        if( result != nullptr || nsize == 0 ) _used = _used - old_size + nsize;
+        return result;
+    }
+
+    std::size_t limit() const { return _limit; }
+    std::size_t used() const { return _used; }
+
+    // Has an allocation ever been refused?
+    bool exceeded() const { return _exceeded; }
+};
+
+} // end namespace
+#endif
@@ -0,0 +1,218 @@
+// batch.hpp
+//
+// Batched lookup of several keys at once.
+//
+// Reading many keys one at a time walks every table along each key from the top, so twenty fields
+// of "services.api.limits" cost twenty lookups of "services", "api" and "limits" before each field
+// is reached. get_many instead merges the keys into a trie of their tokens, and walks it once. Each
+// table shared by several keys is pushed to the stack once, and each of its fields is looked up
+// once, however many keys pass through it:
+//
+//     auto t = cfg.get_many<int,double,std::string>("a.b.x","a.b.y","a.c");      // std::tuple
+//     auto v = cfg.get_many<int>(std::vector<std::string>{"a.b.x","a.b.z"});     // std::vector
+//
+// Keys are fetched first, and then converted in the order given, so the first key of the wrong type
+// is the one reported. A key that passes through a value other than a table reads as nil, and so
+// throws TypeMismatchException or returns the default.
+
+#ifndef __LUACONFIG_BATCH_HPP
+#define __LUACONFIG_BATCH_HPP
+
+#include "core.hpp"
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace luaconfig {
+
+// ============================================================================
+// PathTrie
+
+// Set of Paths, merged on their common leading tokens, for lookup in the given scope
+template<class Scope>
+class PathTrie
+{
+    struct Node {
+        std::size_t path;                  // Path and position of token, if not the root
+        std::size_t depth;
+        std::vector<std::size_t> children; // Indices of child nodes
+        std::vector<std::size_t> keys;     // Indices of Paths ending here
+    };
+
+    std::vector<Path> _paths;
+    std::vector<Node> _nodes;  // Root first
+    std::size_t _depth;        // Tokens in longest Path
+
+    const Path::Token& token( const Node& node) const {
+        return _paths[node.path][node.depth];
+    }
+
+    static bool global(){ return std::is_same<Scope,Global>::value; }
+
+    // At global scope, the first token is always treated as text
+    static bool same_token( const Path::Token& a, const Path::Token& b, bool text){
+        if( text ) return a.key == b.key;
+        if( a.is_index != b.is_index ) return false;
+        return a.is_index ? a.index == b.index : a.key == b.key;
+    }
+
+    void insert( std::size_t i){
+        const Path& path = _paths[i];
+        std::size_t node = 0;
+        for( std::size_t d=0; d<path.size(); ++d){
+            std::size_t next = _nodes.size();
+            for( auto child : _nodes[node].children){
+                if( same_token(token(_nodes[child]),path[d],global() && d==0) ){
+                    next = child;
+                    break;
+                }
+            }
+            if( next == _nodes.size() ){
+                _nodes.push_back( Node{ i, d, {}, {}});
+                _nodes[node].children.push_back(next);
+            }
+            node = next;
+        }
+        // Keys with no tokens are never found, so are left as nil
+        if( node != 0 ) _nodes[node].keys.push_back(i);
+        if( path.size() > _depth ) _depth = path.size();
+    }
+
+    // Copy each field of the table on top of the stack to the slots of the keys ending there,
+    // descending into those that are tables.
+    void visit( lua_State* L, const Node& node, int base, bool global) const {
+        for( auto child : node.children){
+            const Node& c = _nodes[child];
+            const Path::Token& tk = token(c);
+            if( tk.is_index && !global ){
+                lua_geti(L,-1,tk.index);                          // +1, [t,v]
+            } else {
+                lua_pushlstring(L,tk.key.data(),tk.key.size());   // +1, [t,k]
+                lua_gettable(L,-2);                               // +0, [t,v]
+            }
+            for( auto key : c.keys) lua_copy(L,-1,base+static_cast<int>(key));
+            if( !c.children.empty() && lua_istable(L,-1) ) visit(L,c,base,false);
+            lua_pop(L,1);                                         // -1, [t]
+        }
+    }
+
+    public:
+
+    // ====================================================
+    // Constructor
+    // Keys at global scope have their first token treated as text, as in any other lookup.
+
+    explicit PathTrie( std::vector<Path> paths) : _paths(std::move(paths)), _depth(0) {
+        _nodes.push_back( Node{ 0, 0, {}, {}});
+        for( std::size_t i=0; i<_paths.size(); ++i) insert(i);
+    }
+
+    // ====================================================
+    // Access
+
+    std::size_t size() const { return _paths.size(); }
+    const Path& operator[]( std::size_t i) const { return _paths[i]; }
+
+    // ====================================================
+    // Lookup
+    // Pushes the value of each key in order, returning the stack index of the first. At table scope,
+    // the table must be on top of the stack.
+
+    int fetch( lua_State* L) const {
+        LUACONFIG_TIME(L,lookup);
+#ifdef LUACONFIG_INSTRUMENT
+        for( auto&& path : _paths) LUACONFIG_RECORD_LOOKUP(L,path);
+#endif
+        if( !lua_checkstack(L,static_cast<int>(_paths.size()+_depth)+2) ){
+            throw std::runtime_error("luaconfig: too many keys to fetch at once");
+        }
+        int root = lua_gettop(L);
+        int base = root+1;
+        lua_settop(L,root+static_cast<int>(_paths.size()));       // +n, [s...], all nil
+        if( global() ) lua_pushglobaltable(L);
+        else lua_pushvalue(L,root);                               // +1, [s...,t]
+        visit(L,_nodes[0],base,global());
+        lua_pop(L,1);                                             // -1, [s...]
+        return base;
+    }
+};
+
+// ============================================================================
+// Convert fetched values
+
+// throwing version
+template<class T>
+T read_fetched( lua_State* L, int index, const Path& key){
+    lua_pushvalue(L,index);
+    type_test<T>(L,key);
+    return value_to_cpp<T>(L,key);
+}
+
+// non-throwing version with default
+template<class T>
+T read_fetched( lua_State* L, int index, const Path& key, const T& def){
+    (void)key;
+    lua_pushvalue(L,index);
+    T result;
+    if( try_stack_to_cpp(L,result) ) return result;
+    LUACONFIG_COUNT_DEFAULT(L);
+    lua_pop(L,1);
+    return def;
+}
+
+// Braced initialisation evaluates the elements in order
+template<class... T, class Scope, std::size_t... I>
+std::tuple<T...> read_fetched_tuple( lua_State* L, int base, const PathTrie<Scope>& trie, index_sequence<I...>){
+    return std::tuple<T...>{ read_fetched<T>(L,base+static_cast<int>(I),trie[I])... };
+}
+
+// ============================================================================
+// Batched reads
+// The stack is restored afterwards, including when an exception is thrown.
+
+// Keys of mixed type, as a tuple
+template<class Scope, class... T>
+std::tuple<T...> read_many( lua_State* L, const PathTrie<Scope>& trie){
+    LUACONFIG_TIME(L,read);
+    StackGuard guard(L);
+    int base = trie.fetch(L);
+    return read_fetched_tuple<T...>(L,base,trie,make_index_sequence<sizeof...(T)>());
+}
+
+// Keys of one type, as a vector
+template<class T, class Scope>
+std::vector<T> read_list( lua_State* L, const PathTrie<Scope>& trie){
+    LUACONFIG_TIME(L,read);
+    StackGuard guard(L);
+    int base = trie.fetch(L);
+    std::vector<T> result;
+    result.reserve(trie.size());
+    for( std::size_t i=0; i<trie.size(); ++i) result.push_back(read_fetched<T>(L,base+static_cast<int>(i),trie[i]));
+    return result;
+}
+
+template<class T, class Scope>
+std::vector<T> read_list( lua_State* L, const PathTrie<Scope>& trie, const T& def){
+    LUACONFIG_TIME(L,read);
+    StackGuard guard(L);
+    int base = trie.fetch(L);
+    std::vector<T> result;
+    result.reserve(trie.size());
+    for( std::size_t i=0; i<trie.size(); ++i) result.push_back(read_fetched<T>(L,base+static_cast<int>(i),trie[i],def));
+    return result;
+}
+
+// Paths from a list of keys
+template<class K>
+std::vector<Path> to_paths( const std::vector<K>& keys){
+    std::vector<Path> paths;
+    paths.reserve(keys.size());
+    for( auto&& key : keys) paths.push_back(Path(key));
+    return paths;
+}
+
+} // end namespace
+#endif
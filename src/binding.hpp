@@ -0,0 +1,250 @@
+// binding.hpp
+//
+// Decoding of Lua tables directly into C++ structs.
+//
+// A struct is bound by listing its fields after its definition, in the same namespace:
+//
+//     struct Server {
+//         std::string host;
+//         int port = 80;
+//         std::vector<double> weights;
+//     };
+//     LUACONFIG_STRUCT(Server, host, port, weights)
+//
+// after which it may be read like any other type, e.g. setting.get<Server>("primary"). Each field
+// is looked up by its name in a single pass over the table. Missing fields keep the value given by
+// the struct's default constructor, so defaults are written as default member initialisers.
+// Fields may be numbers, bools, strings, Settings, Functions, vectors, or other bound structs.
+// Type mismatches are collected over the whole struct, including nested structs, and reported
+// together in a BindingException.
+//
+// LUACONFIG_STRUCT accepts up to 16 fields. It defines a function luaconfig_fields(T*) returning a
+// tuple of luaconfig::field(name, &T::member), which may also be written by hand to bind fields
+// under different names.
+//
+// Field names are interned once per Lua State and struct type, and kept in the registry, so they
+// are not hashed again on each read.
+
+#ifndef __LUACONFIG_BINDING_HPP
+#define __LUACONFIG_BINDING_HPP
+
+#include "core.hpp"
+
+#include <cstddef>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace luaconfig {
+
+// ============================================================================
+// Field descriptions
+
+template<class T, class M>
+struct Field
+{
+    const char* name;
+    M T::* member;
+};
+
+template<class T, class M>
+Field<T,M> field( const char* name, M T::* member){
+    return Field<T,M>{name,member};
+}
+
+// ============================================================================
+// Interned field names
+// Each bound type keeps a table of its field names in the registry, keyed by a light userdata
+// unique to the type.
+
+template<class T>
+const void* field_names_key(){
+    static const char key = 0;
+    return &key;
+}
+
+template<class Fields, std::size_t I = 0>
+auto set_field_names( lua_State*, const Fields&)
+    -> typename std::enable_if< I == std::tuple_size<Fields>::value, void>::type
+{}
+
+template<class Fields, std::size_t I = 0>
+auto set_field_names( lua_State* L, const Fields& fields)
+    -> typename std::enable_if< I < std::tuple_size<Fields>::value, void>::type
+{
+    lua_pushstring(L,std::get<I>(fields).name);
+    lua_rawseti(L,-2,I+1);
+    set_field_names<Fields,I+1>(L,fields);
+}
+
+// Push table of field names to top of stack, creating it if necessary
+template<class T>
+void push_field_names( lua_State* L){
+    // Side notes follow stack. R=Registry, N=names
+    if( lua_rawgetp(L,LUA_REGISTRYINDEX,field_names_key<T>()) == LUA_TTABLE ) return; // +1, [N]
+    lua_pop(L,1);                                                                     // +0, []
+    auto fields = luaconfig_fields(static_cast<T*>(nullptr));
+    lua_createtable(L,std::tuple_size<decltype(fields)>::value,0);                    // +1, [N]
+    set_field_names(L,fields);
+    lua_pushvalue(L,-1);                                                              // +2, [N,N]
+    lua_rawsetp(L,LUA_REGISTRYINDEX,field_names_key<T>());                            // +1, [N], R[key] = N
+}
+
+// ============================================================================
+// Decoding
+// The table is at index t, and field names at index n. Each field value is fetched to the top of
+// the stack in turn. Errors are appended to errors, prefixed with path.
+
+template<class T>
+void decode_struct( lua_State* L, T& out, const std::string& path, std::vector<std::string>& errors);
+
+// Nested struct
+template<class M>
+auto decode_field( lua_State* L, M& out, const std::string& path, std::vector<std::string>& errors)
+    -> typename std::enable_if< is_bound<M>::value, void>::type
+{
+    if( !lua_istable(L,-1) ){
+        errors.push_back(TypeMismatchException(path.c_str(),"table (as bound struct)",luaL_typename(L,-1)).what());
+        return;
+    }
+    decode_struct(L,out,path,errors);
+}
+
+// Anything else
+template<class M>
+auto decode_field( lua_State* L, M& out, const std::string& path, std::vector<std::string>& errors)
+    -> typename std::enable_if< !is_bound<M>::value && !is_vector<M>::value, void>::type
+{
+    int top = lua_gettop(L);
+    try{
+        type_test<M>(L,path.c_str());
+        lua_pushvalue(L,-1); // stack_to_cpp pops its copy
+        out = stack_to_cpp<M>(L);
+    } catch( const TypeMismatchException& e){
+        errors.push_back(e.what());
+    }
+    lua_settop(L,top);
+}
+
+// Vector
+// Decoded element by element, so that errors name the element, as in "weights.2".
+template<class M>
+auto decode_field( lua_State* L, M& out, const std::string& path, std::vector<std::string>& errors)
+    -> typename std::enable_if< is_vector<M>::value, void>::type
+{
+    using E = typename is_vector<M>::element;
+    if( !lua_istable(L,-1) ){
+        errors.push_back(TypeMismatchException(path.c_str(),"table (as std::vector)",luaL_typename(L,-1)).what());
+        return;
+    }
+    std::size_t n = lua_rawlen(L,-1);
+    M result;
+    result.reserve(n);
+    for( std::size_t i=1; i<=n; ++i){
+        E element{};
+        lua_rawgeti(L,-1,static_cast<lua_Integer>(i));   // +1, [t,e]
+        decode_field(L,element,path + "." + std::to_string(i),errors);
+        lua_pop(L,1);                                    // -1, [t]
+        result.push_back(std::move(element));
+    }
+    out = std::move(result);
+}
+
+template<class T, class Fields, std::size_t I = 0>
+auto decode_fields( lua_State*, T&, const Fields&, int, int, const std::string&, std::vector<std::string>&)
+    -> typename std::enable_if< I == std::tuple_size<Fields>::value, void>::type
+{}
+
+template<class T, class Fields, std::size_t I = 0>
+auto decode_fields( lua_State* L, T& out, const Fields& fields, int t, int n, const std::string& path, std::vector<std::string>& errors)
+    -> typename std::enable_if< I < std::tuple_size<Fields>::value, void>::type
+{
+    // Side notes follow stack. v=value
+    const auto& f = std::get<I>(fields);
+    lua_rawgeti(L,n,I+1);                                // +1, [k]
+    lua_gettable(L,t);                                   // +1, [v], v = t[k]
+    if( !lua_isnil(L,-1) ){
+        decode_field(L,out.*(f.member),path.empty() ? std::string(f.name) : path + "." + f.name,errors);
+    }
+    lua_pop(L,1);                                        // +0, []
+    decode_fields<T,Fields,I+1>(L,out,fields,t,n,path,errors);
+}
+
+// Decode table on top of stack into out, leaving the stack unchanged
+template<class T>
+void decode_struct( lua_State* L, T& out, const std::string& path, std::vector<std::string>& errors){
+    int t = lua_gettop(L);
+    push_field_names<T>(L);                              // +1, [N]
+    decode_fields(L,out,luaconfig_fields(static_cast<T*>(nullptr)),t,t+1,path,errors);
+    lua_pop(L,1);                                        // +0, []
+}
+
+// struct (LUACONFIG_STRUCT)
+template<class T>
+auto stack_to_cpp( lua_State* L)
+    -> typename std::enable_if< is_bound<T>::value, T>::type
+{
+    T result{};
+    std::vector<std::string> errors;
+    decode_struct(L,result,std::string(),errors);
+    lua_pop(L,1);
+    if( !errors.empty() ) throw BindingException(errors);
+    return result;
+}
+
+// Non-throwing version
+// Pops the table and returns true if every field has the right type. Otherwise, the table is left
+// on the stack and false is returned.
+template<class T>
+auto try_stack_to_cpp( lua_State* L, T& result)
+    -> typename std::enable_if< is_bound<T>::value, bool>::type
+{
+    if( !lua_istable(L,-1) ) return false;
+    T decoded{};
+    std::vector<std::string> errors;
+    decode_struct(L,decoded,std::string(),errors);
+    if( !errors.empty() ) return false;
+    result = std::move(decoded);
+    lua_pop(L,1);
+    return true;
+}
+
+} // end namespace
+
+// ============================================================================
+// Binding macros
+// LUACONFIG_FOR_EACH(M,T,a,b,c) expands to M(T,a), M(T,b), M(T,c), for up to 16 arguments.
+
+#define LUACONFIG_EXPAND(x) x
+#define LUACONFIG_CAT_(a,b) a##b
+#define LUACONFIG_CAT(a,b) LUACONFIG_CAT_(a,b)
+#define LUACONFIG_NARGS_(_1,_2,_3,_4,_5,_6,_7,_8,_9,_10,_11,_12,_13,_14,_15,_16,N,...) N
+#define LUACONFIG_NARGS(...) LUACONFIG_EXPAND(LUACONFIG_NARGS_(__VA_ARGS__,16,15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0))
+
+#define LUACONFIG_FE_1(M,T,x) M(T,x)
+#define LUACONFIG_FE_2(M,T,x,...) M(T,x), LUACONFIG_EXPAND(LUACONFIG_FE_1(M,T,__VA_ARGS__))
+#define LUACONFIG_FE_3(M,T,x,...) M(T,x), LUACONFIG_EXPAND(LUACONFIG_FE_2(M,T,__VA_ARGS__))
+#define LUACONFIG_FE_4(M,T,x,...) M(T,x), LUACONFIG_EXPAND(LUACONFIG_FE_3(M,T,__VA_ARGS__))
+#define LUACONFIG_FE_5(M,T,x,...) M(T,x), LUACONFIG_EXPAND(LUACONFIG_FE_4(M,T,__VA_ARGS__))
+#define LUACONFIG_FE_6(M,T,x,...) M(T,x), LUACONFIG_EXPAND(LUACONFIG_FE_5(M,T,__VA_ARGS__))
+#define LUACONFIG_FE_7(M,T,x,...) M(T,x), LUACONFIG_EXPAND(LUACONFIG_FE_6(M,T,__VA_ARGS__))
+#define LUACONFIG_FE_8(M,T,x,...) M(T,x), LUACONFIG_EXPAND(LUACONFIG_FE_7(M,T,__VA_ARGS__))
+#define LUACONFIG_FE_9(M,T,x,...) M(T,x), LUACONFIG_EXPAND(LUACONFIG_FE_8(M,T,__VA_ARGS__))
+#define LUACONFIG_FE_10(M,T,x,...) M(T,x), LUACONFIG_EXPAND(LUACONFIG_FE_9(M,T,__VA_ARGS__))
+#define LUACONFIG_FE_11(M,T,x,...) M(T,x), LUACONFIG_EXPAND(LUACONFIG_FE_10(M,T,__VA_ARGS__))
+#define LUACONFIG_FE_12(M,T,x,...) M(T,x), LUACONFIG_EXPAND(LUACONFIG_FE_11(M,T,__VA_ARGS__))
+#define LUACONFIG_FE_13(M,T,x,...) M(T,x), LUACONFIG_EXPAND(LUACONFIG_FE_12(M,T,__VA_ARGS__))
+#define LUACONFIG_FE_14(M,T,x,...) M(T,x), LUACONFIG_EXPAND(LUACONFIG_FE_13(M,T,__VA_ARGS__))
+#define LUACONFIG_FE_15(M,T,x,...) M(T,x), LUACONFIG_EXPAND(LUACONFIG_FE_14(M,T,__VA_ARGS__))
+#define LUACONFIG_FE_16(M,T,x,...) M(T,x), LUACONFIG_EXPAND(LUACONFIG_FE_15(M,T,__VA_ARGS__))
+#define LUACONFIG_FOR_EACH(M,T,...) LUACONFIG_EXPAND(LUACONFIG_CAT(LUACONFIG_FE_,LUACONFIG_NARGS(__VA_ARGS__))(M,T,__VA_ARGS__))
+
+#define LUACONFIG_FIELD(T,name) luaconfig::field(#name,&T::name)
+
+#define LUACONFIG_STRUCT(T,...) \
+    inline auto luaconfig_fields(T*) -> decltype(std::make_tuple(LUACONFIG_FOR_EACH(LUACONFIG_FIELD,T,__VA_ARGS__))) { \
+        return std::make_tuple(LUACONFIG_FOR_EACH(LUACONFIG_FIELD,T,__VA_ARGS__)); \
+    }
+
+#endif
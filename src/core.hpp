@@ -8,13 +8,20 @@
 
 #include "exceptions.hpp"
 #include "threads.hpp" // also includes Lua libraries
+#include "refs.hpp"
 #include "utils.hpp"
+#include "Path.hpp"
+#include "stats.hpp"
+#include "keys.hpp"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <type_traits>
 #include <tuple> // std::tie
 #include <functional>
+#include <iterator>
+#include <string>
 
 namespace luaconfig {
 
@@ -65,33 +72,134 @@ auto lua_to_stack_single( lua_State* L, Key key)
     return 1;
 } 
 
-// Dot-notation lookup
+// Single token lookup, within table on top of stack
+// Tokens beginning with a digit are treated as integer indices.
+
+inline void lua_to_stack_token( lua_State* L, const char* tk, std::size_t len){
+    if( token_is_index(tk) ){
+        lua_geti(L,-1,token_to_index(tk,len));
+    } else {
+        lua_pushlstring(L,tk,len);
+        lua_gettable(L,-2);
+    }
+}
+
+inline void lua_to_stack_token( lua_State* L, const Path::Token& tk){
+    if( tk.is_index ){
+        lua_geti(L,-1,tk.index);
+    } else {
+        lua_pushlstring(L,tk.key.data(),tk.key.size());
+        lua_gettable(L,-2);
+    }
+}
+
+// First token of a dot-notation lookup
+// At global scope, this is always treated as a text key.
+
+template< class Scope>
+auto lua_to_stack_first( lua_State* L, const char* tk, std::size_t len)
+    -> typename std::enable_if< std::is_same<Scope,Global>::value, int>::type
+{
+    lua_pushglobaltable(L);
+    lua_pushlstring(L,tk,len);
+    lua_gettable(L,-2);
+    return 2;
+}
+
+template< class Scope>
+auto lua_to_stack_first( lua_State* L, const char* tk, std::size_t len)
+    -> typename std::enable_if< std::is_same<Scope,Table>::value, int>::type
+{
+    lua_to_stack_token(L,tk,len);
+    return 1;
+}
+
+// Cached token, whose text is held in the registry
+
+inline void lua_to_stack_token( lua_State* L, const KeyCache::Token& tk){
+    if( tk.is_index ){
+        lua_geti(L,-1,tk.index);
+    } else {
+        push_cached(L,tk);
+        lua_gettable(L,-2);
+    }
+}
+
+template< class Scope>
+auto lua_to_stack_first( lua_State* L, const KeyCache::Token& tk)
+    -> typename std::enable_if< std::is_same<Scope,Global>::value, int>::type
+{
+    lua_rawgeti(L,LUA_REGISTRYINDEX,LUA_RIDX_GLOBALS);
+    push_cached(L,tk);
+    lua_gettable(L,-2);
+    return 2;
+}
 
-static const char* dot_delim = "."; // delimiter string: any compatible chars go here
-static const char* nums = "0123456789";
+template< class Scope>
+auto lua_to_stack_first( lua_State* L, const KeyCache::Token& tk)
+    -> typename std::enable_if< std::is_same<Scope,Table>::value, int>::type
+{
+    lua_to_stack_token(L,tk);
+    return 1;
+}
+
+template< class Scope>
+auto lua_to_stack_first( lua_State* L, const Path::Token& tk)
+    -> typename std::enable_if< std::is_same<Scope,Global>::value, int>::type
+{
+    lua_getglobal(L,tk.key.c_str());
+    return 1;
+}
+
+template< class Scope>
+auto lua_to_stack_first( lua_State* L, const Path::Token& tk)
+    -> typename std::enable_if< std::is_same<Scope,Table>::value, int>::type
+{
+    lua_to_stack_token(L,tk);
+    return 1;
+}
+
+// Cached key lookup
+// Only the first n_tokens tokens are used, where n_tokens > 0.
+
+template< class Scope>
+int lua_to_stack_cached( lua_State* L, const KeyCache::Key& key, std::size_t n_tokens){
+    int n_stack = lua_to_stack_first<Scope>(L,key.tokens[0]);
+    for( std::size_t i=1; i<n_tokens; ++i){
+        lua_to_stack_token(L,key.tokens[i]);
+        ++n_stack;
+    }
+    return n_stack;
+}
+
+// Dot-notation lookup
+// Keys held in the key cache use their interned tokens. Otherwise, tokens are read in place,
+// without copying the key. Keys of a single token bypass the cache, as pushing one token directly
+// costs less than finding it (see bench/core.cpp).
 
 template< class Scope, class Key>
 auto lua_to_stack( lua_State* L, Key key)
-    -> typename std::enable_if< !std::is_integral<Key>::value, int>::type
+    -> typename std::enable_if< !std::is_integral<Key>::value && !std::is_same<Key,Path>::value, int>::type
 {
-    // Need non-const char* for strtok
-    char* keydup = strdup(key);
+    LUACONFIG_RECORD_LOOKUP(L,key);
+    LUACONFIG_TIME(L,lookup);
+    if( std::strchr(key,'.') != nullptr ){
+        if( const KeyCache::Key* cached = cached_key(L,key) ) return lua_to_stack_cached<Scope>(L,*cached,cached->tokens.size());
+    }
+    const char* p = key;
+    const char* tk;
+    std::size_t len;
     // Get first token
-    char* tk = strtok(keydup,dot_delim);
-    const char* tkc = tk;
-    // Perform lookup
-    int n_stack = lua_to_stack_single<Scope>(L,tkc);
+    if( !next_token(p,tk,len) ){
+        lua_pushnil(L);
+        return 1;
+    }
+    // Perform lookup. At global scope, a key containing no dots can be used directly.
+    int n_stack = ( std::is_same<Scope,Global>::value && tk == key && *p == '\0' ) ? lua_to_stack_single<Scope>(L,key) : lua_to_stack_first<Scope>(L,tk,len);
     // Other tokens? Note that all further lookups must occur at table scope.
-    while( (tk = strtok(nullptr,dot_delim)) != nullptr ){
-        const char* tkc = tk;
-        // index lookup, or text key?
-        char first = tkc[0];
-        if( strchr(nums,first) != nullptr ){ // is the first character numeric?
-            int index = atoi(tkc);
-            n_stack += lua_to_stack_single<Table>(L,index);
-        } else {
-            n_stack += lua_to_stack_single<Table>(L,tkc);
-        }
+    while( next_token(p,tk,len) ){
+        lua_to_stack_token(L,tk,len);
+        ++n_stack;
     }
     return n_stack;
 } 
@@ -100,18 +208,58 @@ template< class Scope, class Key>
 auto lua_to_stack( lua_State* L, Key key)
     -> typename std::enable_if< std::is_integral<Key>::value && std::is_same<Scope,Table>::value, int>::type
 {
+    LUACONFIG_RECORD_LOOKUP(L,static_cast<lua_Integer>(key));
+    LUACONFIG_TIME(L,lookup);
     return lua_to_stack_single<Scope>(L,key);
 } 
 
+// Pre-parsed Path lookup
+// Only the first n_tokens tokens are used. Paths share cache entries with the equivalent string key.
+
+template< class Scope>
+int lua_to_stack( lua_State* L, const Path& path, std::size_t n_tokens){
+    LUACONFIG_RECORD_LOOKUP(L,path,n_tokens);
+    LUACONFIG_TIME(L,lookup);
+    if( n_tokens == 0 ){
+        lua_pushnil(L);
+        return 1;
+    }
+    if( n_tokens > 1 ){
+        if( const KeyCache::Key* cached = cached_key(L,path) ) return lua_to_stack_cached<Scope>(L,*cached,n_tokens);
+    }
+    int n_stack = lua_to_stack_first<Scope>(L,path[0]);
+    for( std::size_t i=1; i<n_tokens; ++i){
+        lua_to_stack_token(L,path[i]);
+        ++n_stack;
+    }
+    return n_stack;
+}
+
+template< class Scope>
+int lua_to_stack( lua_State* L, const Path& path){
+    return lua_to_stack<Scope>(L,path,path.size());
+}
+
 // ============================================================================
 // Get stack variable to Lua
 
+// Set field of global table from value on top of stack, with key on top of that
+inline void set_global_keyed( lua_State* L){
+    // Side notes follow stack. v=value, k=key, G=globals
+    lua_rawgeti(L,LUA_REGISTRYINDEX,LUA_RIDX_GLOBALS);   // +1, [v,k,G]
+    lua_rotate(L,-3,1);                                  // +1, [G,v,k]
+    lua_rotate(L,-2,1);                                  // +1, [G,k,v]
+    lua_settable(L,-3);                                  // -1, [G], G[k] = v
+    lua_pop(L,1);                                        // -2, []
+}
+
 // global
 template<class Scope, class Key>
 auto stack_to_lua( lua_State* L, Key key)
-    -> typename std::enable_if< std::is_same<Scope,Global>::value, void>::type
+    -> typename std::enable_if< std::is_same<Scope,Global>::value && !std::is_same<Key,Path>::value, void>::type
 {
-   lua_setglobal(L,key);
+    lua_pushstring(L,key);
+    set_global_keyed(L);
 } 
 
 // table
@@ -134,6 +282,102 @@ auto stack_to_lua( lua_State* L, Key key)
     lua_settable(L,-3);
 } 
 
+// Path
+// All but the final token are used to find the enclosing table, which must already exist. If it, or
+// any value along the way, is not a table, TypeMismatchException is thrown.
+
+inline void stack_to_lua_token( lua_State* L, const Path::Token& tk){
+    if( tk.is_index ){
+        lua_seti(L,-2,tk.index);
+    } else {
+        lua_setfield(L,-2,tk.key.c_str());
+    }
+}
+
+// Final token of path, interned if possible
+inline void stack_to_lua_last( lua_State* L, const Path& path, const KeyCache::Key* cached){
+    if( cached == nullptr || cached->tokens.back().is_index ){
+        stack_to_lua_token(L,path[path.size()-1]);
+    } else {
+        push_cached(L,cached->tokens.back());
+        lua_rotate(L,-2,1);
+        lua_settable(L,-3);
+    }
+}
+
+// First n tokens of path, joined by dots
+inline std::string path_prefix( const Path& path, std::size_t n){
+    std::string result;
+    for( std::size_t i=0; i<n; ++i){
+        if( i != 0 ) result += '.';
+        result += path[i].key;
+    }
+    return result;
+}
+
+// Push the table enclosing the final token, above the value to be set, where path.size() > 1.
+// Returns number of stack objects pushed. On failure, these and the value are popped before throwing.
+template< class Scope>
+int lua_to_stack_parent( lua_State* L, const Path& path, const KeyCache::Key* cached){
+    LUACONFIG_RECORD_LOOKUP(L,path,path.size()-1);
+    LUACONFIG_TIME(L,lookup);
+    // At table scope, the table is beneath the value, so a copy is pushed to look up from
+    int n_stack = 0;
+    if( std::is_same<Scope,Table>::value ){
+        lua_pushvalue(L,-2);
+        n_stack = 1;
+    }
+    n_stack += cached ? lua_to_stack_first<Scope>(L,cached->tokens[0]) : lua_to_stack_first<Scope>(L,path[0]);
+    for( std::size_t i=1; ; ++i){
+        if( !lua_istable(L,-1) ){
+            const char* type = luaL_typename(L,-1);
+            lua_pop(L,n_stack+1);
+            throw TypeMismatchException(path_prefix(path,i).c_str(),"table",type);
+        }
+        if( i == path.size()-1 ) return n_stack;
+        if( cached ) lua_to_stack_token(L,cached->tokens[i]);
+        else lua_to_stack_token(L,path[i]);
+        ++n_stack;
+    }
+}
+
+template< class Scope>
+auto stack_to_lua( lua_State* L, const Path& path)
+    -> typename std::enable_if< std::is_same<Scope,Global>::value, void>::type
+{
+    if( path.size() == 0 ){
+        lua_pop(L,1);
+        return;
+    }
+    if( path.size() == 1 ){
+        lua_setglobal(L,path[0].key.c_str());
+    } else {
+        const KeyCache::Key* cached = cached_key(L,path);
+        int n_stack = lua_to_stack_parent<Scope>(L,path,cached);
+        lua_rotate(L,-(n_stack+1),-1); // move value to top
+        stack_to_lua_last(L,path,cached);
+        lua_pop(L,n_stack);
+    }
+}
+
+template< class Scope>
+auto stack_to_lua( lua_State* L, const Path& path)
+    -> typename std::enable_if< std::is_same<Scope,Table>::value, void>::type
+{
+    if( path.size() == 0 ){
+        lua_pop(L,1);
+        return;
+    }
+    const KeyCache::Key* cached = ( path.size() > 1 ) ? cached_key(L,path) : nullptr;
+    int n_stack = 0;
+    if( path.size() > 1 ){
+        n_stack = lua_to_stack_parent<Scope>(L,path,cached);
+        lua_rotate(L,-(n_stack+1),-1); // move value to top
+    }
+    stack_to_lua_last(L,path,cached);
+    lua_pop(L,n_stack);
+}
+
 // ============================================================================
 // Get C++ variable to top of stack
 
@@ -175,7 +419,7 @@ template<class T>
 auto cpp_to_stack( lua_State* L, const T& value)
     -> typename std::enable_if< std::is_same<T,std::string>::value, void>::type
 {
-    lua_pushstring(L,value.c_str());
+    lua_pushlstring(L,value.data(),value.size());
 }
 
 // ============================================================================
@@ -228,14 +472,9 @@ template<class T>
 auto stack_to_cpp( lua_State* L)
     -> typename std::enable_if< std::is_same<T,Setting>::value || std::is_base_of<FunctionBase,T>::value, T>::type
 {
-    // Create new thread
-    lua_State* p_thread;
-    int thread_id;
-    std::tie(p_thread,thread_id) = new_thread(L);
-    // Move table from top of stack to new thread
-    lua_xmove(L,p_thread,1);
-    // Build and return new Setting    
-    return T(p_thread,thread_id);
+    // Move object from top of stack to registry, build and return new handle
+    int ref = new_ref(L);
+    return T(L,ref);
 }
 
 // function (std::function)
@@ -294,6 +533,22 @@ auto is_type( lua_State* L)
     return lua_istable(L,-1);
 }
 
+// array (std::vector)
+template< class T>
+auto is_type( lua_State* L)
+    -> typename std::enable_if< is_vector<T>::value, bool>::type
+{
+    return lua_istable(L,-1);
+}
+
+// struct (LUACONFIG_STRUCT)
+template< class T>
+auto is_type( lua_State* L)
+    -> typename std::enable_if< is_bound<T>::value, bool>::type
+{
+    return lua_istable(L,-1);
+}
+
 // function
 template<class T>
 auto is_type( lua_State* L)
@@ -309,66 +564,331 @@ inline bool is_nil( lua_State* L){
 
 // Throwing -- throw a custom exception if not matched
 
+// Name of key, as reported in exceptions
+inline const char* key_name( const char* key){ return key; }
+inline const char* key_name( const Path& key){ return key.c_str(); }
+inline int key_name( int key){ return key; }
+
 // float
 template< class T, class K>
-auto type_test( lua_State* L, K key)
+auto type_test( lua_State* L, const K& key)
     -> typename std::enable_if< std::is_floating_point<T>::value, void>::type
 {
-   if( !lua_isnumber(L,-1)) throw TypeMismatchException(key,"number",luaL_typename(L,-1));
+   if( !lua_isnumber(L,-1)) throw TypeMismatchException(key_name(key),"number",luaL_typename(L,-1));
 }
 
 // int
 template< class T, class K>
-auto type_test( lua_State* L, K key)
+auto type_test( lua_State* L, const K& key)
     -> typename std::enable_if< std::is_integral<T>::value && !std::is_same<T,bool>::value, void>::type
 {
-   if( !lua_isinteger(L,-1)) throw TypeMismatchException(key,"number (integer)",luaL_typename(L,-1));
+   if( !lua_isinteger(L,-1)) throw TypeMismatchException(key_name(key),"number (integer)",luaL_typename(L,-1));
 }
 
 // boolean
 template< class T, class K>
-auto type_test( lua_State* L, K key)
+auto type_test( lua_State* L, const K& key)
     -> typename std::enable_if< std::is_same<T,bool>::value, void>::type
 {
-   if( !lua_isboolean(L,-1)) throw TypeMismatchException(key,"boolean",luaL_typename(L,-1));
+   if( !lua_isboolean(L,-1)) throw TypeMismatchException(key_name(key),"boolean",luaL_typename(L,-1));
 }
 
 // string
 template< class T, class K>
-auto type_test( lua_State* L, K key)
+auto type_test( lua_State* L, const K& key)
     -> typename std::enable_if< std::is_same<T,std::string>::value || std::is_same<T,const char*>::value, void>::type
 {
-   if( !lua_isstring(L,-1)) throw TypeMismatchException(key,"string",luaL_typename(L,-1));
+   if( !lua_isstring(L,-1)) throw TypeMismatchException(key_name(key),"string",luaL_typename(L,-1));
 }
 
 // table
 template< class T, class K>
-auto type_test( lua_State* L, K key)
+auto type_test( lua_State* L, const K& key)
     -> typename std::enable_if< std::is_same<T,Setting>::value, void>::type
 {
-   if( !lua_istable(L,-1)) throw TypeMismatchException(key,"table (as luaconfig Setting)",luaL_typename(L,-1));
+   if( !lua_istable(L,-1)) throw TypeMismatchException(key_name(key),"table (as luaconfig Setting)",luaL_typename(L,-1));
+}
+
+// array (std::vector)
+template< class T, class K>
+auto type_test( lua_State* L, const K& key)
+    -> typename std::enable_if< is_vector<T>::value, void>::type
+{
+   if( !lua_istable(L,-1)) throw TypeMismatchException(key_name(key),"table (as std::vector)",luaL_typename(L,-1));
+}
+
+// struct (LUACONFIG_STRUCT)
+template< class T, class K>
+auto type_test( lua_State* L, const K& key)
+    -> typename std::enable_if< is_bound<T>::value, void>::type
+{
+   if( !lua_istable(L,-1)) throw TypeMismatchException(key_name(key),"table (as bound struct)",luaL_typename(L,-1));
 }
 
 // function
 template< class T, class K>
-auto type_test( lua_State* L, K key)
+auto type_test( lua_State* L, const K& key)
     -> typename std::enable_if< std::is_base_of<FunctionBase,T>::value, void>::type
 {
-   if( !lua_isfunction(L,-1)) throw TypeMismatchException(key,"function (as luaconfig Function)",luaL_typename(L,-1));
+   if( !lua_isfunction(L,-1)) throw TypeMismatchException(key_name(key),"function (as luaconfig Function)",luaL_typename(L,-1));
 }
 
 template< class T, class K>
-auto type_test( lua_State* L, K key)
+auto type_test( lua_State* L, const K& key)
     -> typename std::enable_if< is_function<T>::value, void>::type
 {
-   if( !lua_isfunction(L,-1)) throw TypeMismatchException(key,"function (as std::function)",luaL_typename(L,-1));
+   if( !lua_isfunction(L,-1)) throw TypeMismatchException(key_name(key),"function (as std::function)",luaL_typename(L,-1));
+}
+
+// ============================================================================
+// Bulk reading of arrays
+// Reads elements 1..n of the table on top of the stack, which is not popped. Where the name of the
+// table is known, errors name the element in full, as in "weights.3". Otherwise, they give only its
+// index.
+//
+// Numeric elements are fetched with raw access a chunk at a time into a buffer of lua_Integer or
+// lua_Number, and type checked for the whole chunk at once. The buffer is then converted to the
+// requested type in a tight loop, which the compiler is free to vectorise. Other types are read one
+// element at a time.
+
+// Number of elements converted at a time
+static const std::size_t bulk_chunk_size = 256;
+
+// array (std::vector)
+template<class T>
+auto stack_to_cpp( lua_State* L)
+    -> typename std::enable_if< is_vector<T>::value, T>::type;
+
+// struct (LUACONFIG_STRUCT), defined in binding.hpp
+template<class T>
+auto stack_to_cpp( lua_State* L)
+    -> typename std::enable_if< is_bound<T>::value, T>::type;
+
+// array (std::vector) of the given name, which may be nullptr
+template<class T>
+T vector_to_cpp( lua_State* L, const char* name);
+
+// Name of element idx of the table called name
+inline std::string element_name( const char* name, int idx){
+    return std::string(name) + "." + std::to_string(idx);
+}
+
+// Type test element idx of the table called name, which may be nullptr
+template<class T>
+void element_test( lua_State* L, const char* name, int idx){
+    if( name == nullptr ) type_test<T>(L,idx);
+    else type_test<T>(L,element_name(name,idx).c_str());
+}
+
+// Convert element idx of the table called name, so that nested arrays name their elements in full
+template<class T>
+auto element_to_cpp( lua_State* L, const char*, int)
+    -> typename std::enable_if< !is_vector<T>::value, T>::type
+{
+    return stack_to_cpp<T>(L);
+}
+
+template<class T>
+auto element_to_cpp( lua_State* L, const char* name, int idx)
+    -> typename std::enable_if< is_vector<T>::value, T>::type
+{
+    if( name == nullptr ) return vector_to_cpp<T>(L,nullptr);
+    return vector_to_cpp<T>(L,element_name(name,idx).c_str());
+}
+
+// Convert buffer to requested type
+template<class T, class U>
+inline void convert_n( const U* in, std::size_t n, T* out){
+    for( std::size_t i=0; i<n; ++i) out[i] = static_cast<T>(in[i]);
+}
+
+// Fetch raw element, report whether it has the expected type
+inline bool fetch_element( lua_State* L, lua_Integer idx, lua_Integer& result){
+    lua_rawgeti(L,-1,idx);
+    bool ok = lua_isinteger(L,-1);
+    result = lua_tointeger(L,-1);
+    lua_pop(L,1);
+    return ok;
+}
+
+inline bool fetch_element( lua_State* L, lua_Integer idx, lua_Number& result){
+    lua_rawgeti(L,-1,idx);
+    int ok;
+    result = lua_tonumberx(L,-1,&ok);
+    lua_pop(L,1);
+    return ok;
+}
+
+// numeric
+// Non-throwing version, returns false at the first chunk containing an element of the wrong type
+template<class T>
+auto try_read_array( lua_State* L, T* out, std::size_t n)
+    -> typename std::enable_if< std::is_arithmetic<T>::value && !std::is_same<T,bool>::value, bool>::type
+{
+    using raw = typename std::conditional< std::is_integral<T>::value, lua_Integer, lua_Number>::type;
+    raw buffer[bulk_chunk_size];
+    for( std::size_t start=0; start<n; start+=bulk_chunk_size){
+        std::size_t chunk = std::min(bulk_chunk_size,n-start);
+        // Fetch and type check
+        bool ok = true;
+        for( std::size_t i=0; i<chunk; ++i){
+            ok &= fetch_element(L,static_cast<lua_Integer>(start+i+1),buffer[i]);
+        }
+        if( !ok ) return false;
+        convert_n(buffer,chunk,out+start);
+    }
+    return true;
+}
+
+template<class T>
+auto read_array( lua_State* L, T* out, std::size_t n, const char* name = nullptr)
+    -> typename std::enable_if< std::is_arithmetic<T>::value && !std::is_same<T,bool>::value, void>::type
+{
+    if( try_read_array(L,out,n) ) return;
+    // Report first offending element
+    for( std::size_t i=0; i<n; ++i){
+        int idx = static_cast<int>(i+1);
+        lua_rawgeti(L,-1,idx);
+        element_test<T>(L,name,idx);
+        lua_pop(L,1);
+    }
+}
+
+// other types
+template<class itype>
+void read_array( lua_State* L, itype it, std::size_t n, const char* name = nullptr){
+    using T = typename std::iterator_traits<itype>::value_type;
+    for( std::size_t i=0; i<n; ++i, ++it){
+        int idx = static_cast<int>(i+1);
+        lua_rawgeti(L,-1,idx);
+        element_test<T>(L,name,idx);
+        *it = element_to_cpp<T>(L,name,idx);
+    }
+}
+
+template<class T>
+auto try_stack_to_cpp( lua_State* L, T& result)
+    -> typename std::enable_if< is_vector<T>::value, bool>::type;
+
+// struct (LUACONFIG_STRUCT), defined in binding.hpp
+template<class T>
+auto try_stack_to_cpp( lua_State* L, T& result)
+    -> typename std::enable_if< is_bound<T>::value, bool>::type;
+
+// Read one element, popping it only if it has the right type
+template<class T, class itype>
+auto try_read_element( lua_State* L, itype it)
+    -> typename std::enable_if< !is_vector<T>::value && !is_bound<T>::value, bool>::type
+{
+    if( !is_type<T>(L) ) return false;
+    *it = stack_to_cpp<T>(L);
+    return true;
+}
+
+template<class T, class itype>
+auto try_read_element( lua_State* L, itype it)
+    -> typename std::enable_if< is_vector<T>::value || is_bound<T>::value, bool>::type
+{
+    T element;
+    if( !try_stack_to_cpp(L,element) ) return false;
+    *it = std::move(element);
+    return true;
+}
+
+template<class itype>
+bool try_read_array( lua_State* L, itype it, std::size_t n){
+    using T = typename std::iterator_traits<itype>::value_type;
+    for( std::size_t i=0; i<n; ++i, ++it){
+        lua_rawgeti(L,-1,static_cast<int>(i+1));
+        if( !try_read_element<T>(L,it) ){
+            lua_pop(L,1);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Output location for vector contents
+// std::vector<bool> does not provide data(), so must be read via its iterators.
+template<class T, class Alloc>
+T* vector_data( std::vector<T,Alloc>& v){
+    return v.data();
+}
+
+template<class Alloc>
+typename std::vector<bool,Alloc>::iterator vector_data( std::vector<bool,Alloc>& v){
+    return v.begin();
+}
+
+// array (std::vector)
+// Presized from the raw length of the table
+template<class T>
+T vector_to_cpp( lua_State* L, const char* name){
+    T result(lua_rawlen(L,-1));
+    read_array(L,vector_data(result),result.size(),name);
+    lua_pop(L,1);
+    return result;
+}
+
+template<class T>
+auto stack_to_cpp( lua_State* L)
+    -> typename std::enable_if< is_vector<T>::value, T>::type
+{
+    return vector_to_cpp<T>(L,nullptr);
+}
+
+// ============================================================================
+// Conversion of a value looked up by key
+// As stack_to_cpp, but arrays name their elements after the key.
+
+inline std::string key_string( const char* key){ return key; }
+inline std::string key_string( const Path& key){ return key.str(); }
+inline std::string key_string( int key){ return std::to_string(key); }
+
+template<class T, class K>
+auto value_to_cpp( lua_State* L, const K&)
+    -> typename std::enable_if< !is_vector<T>::value, T>::type
+{
+    return stack_to_cpp<T>(L);
+}
+
+template<class T, class K>
+auto value_to_cpp( lua_State* L, const K& key)
+    -> typename std::enable_if< is_vector<T>::value, T>::type
+{
+    return vector_to_cpp<T>(L,key_string(key).c_str());
+}
+
+// ============================================================================
+// Non-throwing conversion
+// Pops the value and returns true if it and, for arrays, all its elements have the right type.
+// Otherwise, the value is left on the stack and false is returned.
+
+template<class T>
+auto try_stack_to_cpp( lua_State* L, T& result)
+    -> typename std::enable_if< !is_vector<T>::value && !is_bound<T>::value, bool>::type
+{
+    if( !is_type<T>(L) ) return false;
+    result = stack_to_cpp<T>(L);
+    return true;
+}
+
+template<class T>
+auto try_stack_to_cpp( lua_State* L, T& result)
+    -> typename std::enable_if< is_vector<T>::value, bool>::type
+{
+    if( !lua_istable(L,-1) ) return false;
+    result.resize(lua_rawlen(L,-1));
+    if( !try_read_array(L,vector_data(result),result.size()) ) return false;
+    lua_pop(L,1);
+    return true;
 }
 
 // ============================================================================
 // Test existance of a variable
 
 template< class Scope, class K>
-bool exists( lua_State* L, K key){
+bool exists( lua_State* L, const K& key){
     int stack_size = lua_to_stack<Scope>(L,key);
     bool result = !is_nil(L);
     lua_pop(L,stack_size);
@@ -380,23 +900,25 @@ bool exists( lua_State* L, K key){
 
 // throwing version
 template< class T, class Scope, class K>
-T read( lua_State* L, K key){
+T read( lua_State* L, const K& key){
+    LUACONFIG_TIME(L,read);
     int stack_size = lua_to_stack<Scope>(L,key);
     type_test<T>(L,key);
-    T result = stack_to_cpp<T>(L);
+    T result = value_to_cpp<T>(L,key);
     lua_pop(L,stack_size-1);
     return result;
 }
 
 // non-throwing version with default
 template< class T, class Scope, class K>
-T read( lua_State* L, K key, T def){ 
+T read( lua_State* L, const K& key, T def){ 
+    LUACONFIG_TIME(L,read);
     int stack_size = lua_to_stack<Scope>(L,key);
     T result;
-    if ( is_type<T>(L) ){
-        result = stack_to_cpp<T>(L);
+    if ( try_stack_to_cpp(L,result) ){
         lua_pop(L,stack_size-1);
     } else {
+        LUACONFIG_COUNT_DEFAULT(L);
         result = def;
         lua_pop(L,stack_size);
     }
@@ -406,7 +928,7 @@ T read( lua_State* L, K key, T def){
 // iterable version
 template<class itype, class Scope, class K,
          class rtype = decltype(*std::declval<itype>()) >
-inline void read( lua_State* L, K key, itype it, itype end)
+inline void read( lua_State* L, const K& key, itype it, itype end)
 {
     int stack_size = lua_to_stack<Scope>(L,key);
     type_test<Setting>(L,key); // There should be a Lua table on the stack
@@ -418,11 +940,72 @@ inline void read( lua_State* L, K key, itype it, itype end)
     lua_pop(L,stack_size);
 }
 
+// pointer version, reads exactly n elements
+template<class T, class Scope, class K>
+inline void read( lua_State* L, const K& key, T* out, std::size_t n)
+{
+    int stack_size = lua_to_stack<Scope>(L,key);
+    type_test<Setting>(L,key); // There should be a Lua table on the stack
+    read_array(L,out,n,key_string(key).c_str());
+    lua_pop(L,stack_size);
+}
+
+// ===========================================================================
+// Read nested tables into a flat row-major array
+// The shape is found by following the first element of each nested table. Every table is then
+// checked to match this shape as it is read, so no intermediate objects are created.
+
+template<class itype, class K>
+void read_ndarray_level( lua_State* L, const K& key, const std::vector<std::size_t>& shape, std::size_t dim, itype& out){
+    std::size_t n = lua_rawlen(L,-1);
+    if( n != shape[dim] ) throw ShapeMismatchException(key_name(key),dim,shape[dim],n);
+    if( dim+1 == shape.size() ){
+        read_array(L,out,n);
+        out += n;
+    } else {
+        for( std::size_t i=1; i<=n; ++i){
+            lua_rawgeti(L,-1,i);
+            if( !lua_istable(L,-1) ) throw ShapeMismatchException(key_name(key),dim+1,shape[dim+1],luaL_typename(L,-1));
+            read_ndarray_level(L,key,shape,dim+1,out);
+            lua_pop(L,1);
+        }
+    }
+}
+
+template<class T, class Scope, class K>
+void read_ndarray( lua_State* L, const K& key, std::vector<std::size_t>& shape, std::vector<T>& data){
+    int stack_size = lua_to_stack<Scope>(L,key);
+    type_test<Setting>(L,key); // There should be a Lua table on the stack
+    // Find shape
+    shape.clear();
+    int depth = 0;
+    while( lua_istable(L,-1) ){
+        std::size_t n = lua_rawlen(L,-1);
+        shape.push_back(n);
+        if( n == 0 ) break;
+        if( !lua_checkstack(L,1) ){
+            lua_pop(L,stack_size+depth);
+            throw std::runtime_error("luaconfig: array nested too deeply to read");
+        }
+        lua_rawgeti(L,-1,1);
+        ++depth;
+    }
+    lua_pop(L,depth);
+    // Read
+    std::size_t size = 1;
+    for( auto&& n : shape) size *= n;
+    data.resize(size);
+    // Walked even when empty, so that rows longer than an empty first row are caught
+    auto out = vector_data(data);
+    read_ndarray_level(L,key,shape,0,out);
+    lua_pop(L,stack_size);
+}
+
 // ===========================================================================
 // Get length of named object
 
 template<class Scope, class K>
-std::size_t len( lua_State* L, K key){
+std::size_t len( lua_State* L, const K& key){
     int stack_size = lua_to_stack<Scope>(L,key);
     lua_len(L,-1);
     auto size = stack_to_cpp<std::size_t>(L);
@@ -434,25 +1017,24 @@ std::size_t len( lua_State* L, K key){
 // Get from C++ to stack, type check, get from C++ to Lua
 
 template< class Scope, class K, class T>
-void write( lua_State* L, K key, T t){
+void write( lua_State* L, const K& key, T t){
     cpp_to_stack( L, t);
     type_test<T>( L, key);
     stack_to_lua<Scope>( L, key);
 }
 
 // ============================================================================
-// Look up something on State_1, use it to overwrite top of State_2 stack
-// Allows reuse of Setting and Function objects without rebuilding a Lua State
+// Look up something, use it to replace a referenced object
+// Allows reuse of Setting and Function objects without creating new references
 
 template<class T, class Scope, class K>
-void refocus( lua_State* from, lua_State* to, K key){
-        // drop top of 'to'
-        lua_pop(to,1);
+void refocus( lua_State* L, int ref, const K& key){
         // get new T
-        lua_to_stack<Scope>(from,key);
-        type_test<T>(from,key);
-        // transfer
-        lua_xmove( from, to, 1);
+        int stack_size = lua_to_stack<Scope>(L,key);
+        type_test<T>(L,key);
+        // replace referenced object
+        replace_ref(L,ref);
+        lua_pop(L,stack_size-1);
 }
 
 // ============================================================================
@@ -0,0 +1,131 @@
+// diff.hpp
+//
+// Structural comparison of Snapshots, and matching of the changed keys against patterns.
+//
+// diff(before,after) lists the dot-notation keys of every value that was added, removed or changed
+// between two Snapshots, e.g. {"pools.db.size", "pools.cache", "timeout"}. Integer keys are written
+// in decimal, so the results may be passed straight back to get. When a whole table is added or
+// removed, or replaced by a value of another type, only the table's own key is listed.
+//
+// Every Snapshot node carries a hash of its contents, so subtrees with equal hashes are skipped
+// without being visited. The cost of a diff therefore depends on the size of the change rather
+// than the size of the config.
+//
+// Functions are compared by their bytecode, so a function is only reported if its definition
+// changes. Tables that appear in cycles may be reported even if unchanged.
+//
+// key_matches(pattern,key) tests a key against a dot-notation pattern in which '*' matches any one
+// token and '**' matches any number of trailing tokens. Only the tokens the two have in common are
+// compared, so "pools.*.size" matches "pools.db.size" and anything within it, but also "pools" and
+// "pools.db", as replacing those may change the size too.
+
+#ifndef __LUACONFIG_DIFF_HPP
+#define __LUACONFIG_DIFF_HPP
+
+#include "Path.hpp"
+#include "Snapshot.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace luaconfig {
+
+// ============================================================================
+// Diff
+
+class SnapshotDiff
+{
+    const SnapshotView& _a;
+    const SnapshotView& _b;
+    std::vector<std::string>& _out;
+    std::unordered_set<std::uint64_t> _visited; // Pairs of tables already compared
+    std::string _key;                          // Key of current node
+
+    // Append token to _key, returning previous length so that it may be restored
+    std::size_t push_token( const SnapshotView& view, const SnapshotEntry& e){
+        std::size_t size = _key.size();
+        if( size != 0 ) _key += '.';
+        if( e.is_index ) _key += std::to_string(e.index);
+        else _key.append(view.strings+e.key,e.key_size);
+        return size;
+    }
+
+    void report( const SnapshotView& view, const SnapshotEntry& e){
+        std::size_t size = push_token(view,e);
+        _out.push_back(_key);
+        _key.resize(size);
+    }
+
+    static int compare( const SnapshotView& a, const SnapshotEntry& ea, const SnapshotView& b, const SnapshotEntry& eb){
+        if( ea.is_index != eb.is_index ) return ea.is_index ? -1 : 1;
+        if( ea.is_index ) return (ea.index < eb.index) ? -1 : (ea.index > eb.index);
+        return SnapshotBuilder::compare_key(a.strings+ea.key,ea.key_size,b.strings+eb.key,eb.key_size);
+    }
+
+    public:
+
+    SnapshotDiff( const SnapshotView& a, const SnapshotView& b, std::vector<std::string>& out) : _a(a), _b(b), _out(out) {}
+
+    void compare( std::uint32_t a, std::uint32_t b){
+        const SnapshotNode& na = _a.nodes[a];
+        const SnapshotNode& nb = _b.nodes[b];
+        if( na.type == nb.type && na.hash == nb.hash ) return;
+        if( na.type != snapshot_table || nb.type != snapshot_table ){
+            _out.push_back(_key);
+            return;
+        }
+        if( !_visited.insert( (static_cast<std::uint64_t>(a) << 32) | b).second ) return;
+        // Entries of both tables are sorted in the same order, so may be merged
+        const SnapshotEntry* ia = _a.entries + na.first;
+        const SnapshotEntry* ea = ia + na.size;
+        const SnapshotEntry* ib = _b.entries + nb.first;
+        const SnapshotEntry* eb = ib + nb.size;
+        while( ia != ea || ib != eb ){
+            int cmp = ( ia == ea ) ? 1 : ( ib == eb ) ? -1 : compare(_a,*ia,_b,*ib);
+            if( cmp < 0 ){
+                report(_a,*ia++);        // removed
+            } else if( cmp > 0 ){
+                report(_b,*ib++);        // added
+            } else {
+                std::size_t size = push_token(_a,*ia);
+                compare(ia->node,ib->node);
+                _key.resize(size);
+                ++ia;
+                ++ib;
+            }
+        }
+    }
+};
+
+// Keys of values that differ between two Snapshots
+inline std::vector<std::string> diff( const Snapshot& before, const Snapshot& after){
+    std::vector<std::string> result;
+    SnapshotDiff(before.view(),after.view(),result).compare(before.root(),after.root());
+    return result;
+}
+
+// ============================================================================
+// Pattern matching
+
+inline bool key_matches( const char* pattern, const char* key){
+    const char* pt;
+    const char* kt;
+    std::size_t p_len, k_len;
+    while( next_token(pattern,pt,p_len) ){
+        if( p_len == 2 && pt[0] == '*' && pt[1] == '*' ) return true;
+        if( !next_token(key,kt,k_len) ) return true;
+        if( p_len == 1 && pt[0] == '*' ) continue;
+        if( p_len != k_len || std::memcmp(pt,kt,p_len) != 0 ) return false;
+    }
+    return true;
+}
+
+inline bool key_matches( const std::string& pattern, const std::string& key){
+    return key_matches(pattern.c_str(),key.c_str());
+}
+
+} // end namespace
+#endif
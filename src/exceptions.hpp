@@ -5,8 +5,10 @@
 #ifndef __LUACONFIG_EXCEPTION_HPP
 #define __LUACONFIG_EXCEPTION_HPP
 
+#include <cstddef>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace luaconfig {
 
@@ -40,5 +42,91 @@ class TypeMismatchException : public std::runtime_error
     ) {}
 };
 
+// Function exception
+// Thrown when a Lua function raises an error while being called from C++. The message includes a
+// Lua traceback.
+class FunctionException : public std::runtime_error
+{
+    public:
+    FunctionException( const char* msg) : std::runtime_error(msg) {}
+};
+
+// Binding exception
+// Thrown when a table is decoded into a bound struct and one or more fields have the wrong type.
+// Every mismatch found is reported, rather than only the first.
+class BindingException : public std::runtime_error
+{
+    std::vector<std::string> _errors;
+
+    static std::string join( const std::vector<std::string>& errors){
+        std::string msg = "Binding failed with " + std::to_string(errors.size()) + " error(s)";
+        for( auto&& e : errors) msg += "\n    " + e;
+        return msg;
+    }
+
+    public:
+
+    BindingException( const std::vector<std::string>& errors) : std::runtime_error(join(errors)), _errors(errors) {}
+
+    const std::vector<std::string>& errors() const { return _errors; }
+};
+
+// Memory exception
+// Thrown when Lua runs out of memory during a protected call, such as when the limit of a
+// BudgetAllocator is reached while loading a file.
+class MemoryException : public std::runtime_error
+{
+    public:
+    MemoryException( const char* msg) : std::runtime_error(msg) {}
+};
+
+// Shape exception
+// Thrown when reading a nested table as an N-dimensional array, if the nested tables are not all
+// of the same length at a given depth.
+class ShapeMismatchException : public std::runtime_error
+{
+    static std::string name( const char* key){ return std::string{"array \""} + std::string{key} + std::string{"\""}; }
+    static std::string name( int index){ return std::string{"array at index \""} + std::to_string(index) + std::string{"\""}; }
+
+    static std::string length( std::size_t dim, std::size_t expected, std::size_t actual){
+        return std::string{" expected length "} + std::to_string(expected)
+            +std::string{" in dimension "} + std::to_string(dim)
+            +std::string{" but found length "} + std::to_string(actual);
+    }
+
+    static std::string type( std::size_t dim, std::size_t expected, const char* actual){
+        return std::string{" expected table of length "} + std::to_string(expected)
+            +std::string{" in dimension "} + std::to_string(dim)
+            +std::string{" but found type \""} + std::string{actual} + std::string{"\""};
+    }
+
+    public:
+
+    ShapeMismatchException( const char* key, std::size_t dim, std::size_t expected, std::size_t actual) : std::runtime_error(
+        std::string{"Lookup for "} + name(key) + length(dim,expected,actual)
+    ) {}
+
+    ShapeMismatchException( int index, std::size_t dim, std::size_t expected, std::size_t actual) : std::runtime_error(
+        std::string{"Lookup for "} + name(index) + length(dim,expected,actual)
+    ) {}
+
+    // An element that should have been a nested table was not
+    ShapeMismatchException( const char* key, std::size_t dim, std::size_t expected, const char* actual) : std::runtime_error(
+        std::string{"Lookup for "} + name(key) + type(dim,expected,actual)
+    ) {}
+
+    ShapeMismatchException( int index, std::size_t dim, std::size_t expected, const char* actual) : std::runtime_error(
+        std::string{"Lookup for "} + name(index) + type(dim,expected,actual)
+    ) {}
+};
+
+// Serialize exception
+// Thrown when a value cannot be written out as Lua source, such as a table that contains itself.
+class SerializeException : public std::runtime_error
+{
+    public:
+    SerializeException( const char* msg) : std::runtime_error(msg) {}
+};
+
 } // namespace end
 #endif
@@ -0,0 +1,185 @@
+// keys.hpp
+//
+// Cache of string keys interned in the Lua registry.
+//
+// Pushing a key with lua_pushstring makes Lua hash the string and look it up in its string table,
+// once for every token of every lookup. Instead, each Config keeps a KeyCache mapping dot-notation
+// keys to their tokens, with the text of each token held as a Lua string in the registry. A cached
+// string key costs one hash of the whole key in C++, after which each token is pushed with
+// lua_rawgeti. A Path carries the hash of its key, so it is not hashed again.
+// Keys are parsed and interned the first time they are read. Keys that are only written, such as
+// those passed to set, are pushed directly and never enter the cache.
+//
+// The cache holds a bounded number of keys, so that keys built on the fly (e.g. "item" + i) cannot
+// grow it without limit. Keys are never evicted. Once the cache is full, string keys are no longer
+// hashed, and are looked up as before at no extra cost. A Path still finds its key if it was cached
+// earlier. The registry strings live as long as the Lua State, and are never released individually.
+//
+// A pointer to the cache is kept in the extra space Lua reserves in front of each lua_State. Each
+// thread has its own extra space, which lua_newthread copies from the main thread when the thread
+// is created. The pointer is therefore set when the Config is created, before any threads exist,
+// and never changed, so that every thread sees it. Unlike the registry, it is read without touching
+// the Lua stack, so checking the cache costs nothing when it is absent or disabled.
+
+#ifndef __LUACONFIG_KEYS_HPP
+#define __LUACONFIG_KEYS_HPP
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+}
+
+#include "Path.hpp"
+#include "utils.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace luaconfig {
+
+class KeyCache
+{
+    public:
+
+    struct Token {
+        int ref;           // Registry reference to token text
+        lua_Integer index; // Integer index, if is_index
+        bool is_index;
+    };
+
+    struct Key {
+        std::string str;
+        std::size_t hash;
+        int ref;                   // Registry reference to whole key, or LUA_NOREF if slot is empty
+        std::vector<Token> tokens;
+    };
+
+    static const std::size_t default_limit = 4096;
+
+    private:
+
+    std::vector<Key> _slots; // Open addressing with linear probing, size a power of two
+    std::size_t _size;
+    std::size_t _limit;
+
+    // Hash, also finding length
+    static std::size_t hash( const char* key, std::size_t& len){
+        len = std::strlen(key);
+        return static_cast<std::size_t>(fnv1a(key,len));
+    }
+
+    static int intern( lua_State* L, const char* str, std::size_t len){
+        lua_pushlstring(L,str,len);
+        return luaL_ref(L,LUA_REGISTRYINDEX);
+    }
+
+    // Slot holding key, or empty slot where it should be placed
+    Key& probe( const char* key, std::size_t len, std::size_t h){
+        std::size_t mask = _slots.size()-1;
+        for( std::size_t i = h & mask;; i = (i+1) & mask){
+            Key& slot = _slots[i];
+            if( slot.ref == LUA_NOREF ) return slot;
+            if( slot.hash == h && slot.str.size() == len && std::memcmp(slot.str.data(),key,len) == 0 ) return slot;
+        }
+    }
+
+    void grow(){
+        std::vector<Key> old(2*_slots.size());
+        for( auto&& slot : old) slot.ref = LUA_NOREF;
+        old.swap(_slots);
+        for( auto&& slot : old){
+            if( slot.ref == LUA_NOREF ) continue;
+            Key& dest = probe(slot.str.data(),slot.str.size(),slot.hash);
+            dest = std::move(slot);
+        }
+    }
+
+    public:
+
+    KeyCache( std::size_t limit = default_limit) : _slots(64), _size(0), _limit(limit) {
+        for( auto&& slot : _slots) slot.ref = LUA_NOREF;
+    }
+
+    KeyCache( const KeyCache&) = delete;
+    KeyCache& operator=( const KeyCache&) = delete;
+
+    std::size_t size() const { return _size; }
+    std::size_t limit() const { return _limit; }
+
+    // Lowering the limit stops new keys from being added, but keeps those already cached. A limit
+    // of zero bypasses the cache entirely.
+    void set_limit( std::size_t limit){ _limit = limit; }
+
+    bool full() const { return _size >= _limit; }
+
+    // Find key, adding it if there is room
+    // Returns nullptr if the key has no tokens, or is not cached and the cache is full. The result is
+    // valid until the next call. String keys are not searched for once the cache is full, as hashing
+    // them would cost more than it saves.
+    const Key* find( lua_State* L, const char* key){
+        if( full() ) return nullptr;
+        std::size_t len;
+        std::size_t h = hash(key,len);
+        return find(L,key,len,h);
+    }
+
+    const Key* find( lua_State* L, const Path& key){
+        if( _limit == 0 ) return nullptr;
+        return find(L,key.c_str(),key.str().size(),key.hash());
+    }
+
+    // Key of length len with hash h
+    const Key* find( lua_State* L, const char* key, std::size_t len, std::size_t h){
+        if( len == 0 ) return nullptr;
+        Key* slot = &probe(key,len,h);
+        if( slot->ref != LUA_NOREF ) return slot;
+        if( full() ) return nullptr;
+        // Keep load factor below one half
+        if( 2*(_size+1) > _slots.size() ){
+            grow();
+            slot = &probe(key,len,h);
+        }
+        slot->str.assign(key,len);
+        slot->hash = h;
+        slot->tokens.clear();
+        const char* p = key;
+        const char* tk;
+        std::size_t tk_len;
+        while( next_token(p,tk,tk_len) ){
+            bool is_index = token_is_index(tk);
+            slot->tokens.push_back( Token{ intern(L,tk,tk_len), is_index ? token_to_index(tk,tk_len) : 0, is_index});
+        }
+        // Keys of dots alone have no tokens. The slot is left empty.
+        if( slot->tokens.empty() ) return nullptr;
+        slot->ref = intern(L,key,len);
+        ++_size;
+        return slot;
+    }
+
+    // ====================================================
+    // Access from Lua State
+
+    static KeyCache*& of( lua_State* L){
+        return *static_cast<KeyCache**>(lua_getextraspace(L));
+    }
+};
+
+// Cached key, or nullptr if the Lua State has no cache or the key could not be cached
+inline const KeyCache::Key* cached_key( lua_State* L, const char* key){
+    KeyCache* cache = KeyCache::of(L);
+    return cache ? cache->find(L,key) : nullptr;
+}
+
+inline const KeyCache::Key* cached_key( lua_State* L, const Path& key){
+    KeyCache* cache = KeyCache::of(L);
+    return cache ? cache->find(L,key) : nullptr;
+}
+
+inline void push_cached( lua_State* L, const KeyCache::Token& tk){
+    lua_rawgeti(L,LUA_REGISTRYINDEX,tk.ref);
+}
+
+} // end namespace
+#endif
@@ -0,0 +1,307 @@
+// load.hpp
+//
+// Functions for loading and running Lua chunks for luaconfig.
+//
+// All loaders leave the global scope populated by the chunk, and throw a FileException containing
+// Lua's error message on failure. Besides named files, chunks may be loaded from memory-mapped files,
+// from buffers in memory, and from file descriptors such as pipes.
+//
+// The BytecodeCache stores the result of compiling a file (as produced by lua_dump) and reuses it on
+// later loads, skipping the parser. A cached file is only used if the size, modification time and
+// contents hash of the source all match those recorded when the cache was written. Otherwise, the
+// source is compiled as normal and the cache rewritten. Failing to read or write the cache is never
+// an error; the source is simply loaded directly.
+//
+// Lua does not verify bytecode, so malformed bytecode can crash the interpreter. Only use a cache
+// directory that untrusted users cannot write to.
+
+#ifndef __LUACONFIG_LOAD_HPP
+#define __LUACONFIG_LOAD_HPP
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+#include "exceptions.hpp"
+#include "utils.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace luaconfig {
+
+// ============================================================================
+// Run chunk on top of stack, or throw if status indicates an error
+
+inline void run_chunk( lua_State* L, int status){
+    if( status == LUA_OK ) status = lua_pcall(L,0,0,0);
+    if( status != LUA_OK ){
+        std::string msg = lua_tostring(L,-1) ? lua_tostring(L,-1) : "unknown error";
+        lua_pop(L,1);
+        if( status == LUA_ERRMEM ) throw MemoryException(msg.c_str());
+        throw FileException(msg.c_str());
+    }
+}
+
+// ============================================================================
+// Load from named file
+
+inline void load_file( lua_State* L, const char* filename){
+    run_chunk(L,luaL_loadfile(L,filename));
+}
+
+// ============================================================================
+// Load from memory
+// The buffer is read in place, and need only remain valid for the duration of the call. As with
+// files, a leading line beginning with '#' is skipped, though its newline is kept so that line
+// numbers in error messages are unchanged.
+
+inline std::size_t comment_length( const char* data, std::size_t size){
+    if( size == 0 || data[0] != '#' ) return 0;
+    const char* nl = static_cast<const char*>(std::memchr(data,'\n',size));
+    return nl ? static_cast<std::size_t>(nl-data) : size;
+}
+
+inline void load_buffer( lua_State* L, const char* data, std::size_t size, const char* chunkname){
+    std::size_t skip = comment_length(data,size);
+    run_chunk(L,luaL_loadbufferx(L,data+skip,size-skip,chunkname,nullptr));
+}
+
+// ============================================================================
+// Load from memory-mapped file
+// The file is mapped read-only and parsed directly from the mapping, avoiding stdio buffering and
+// any copying of its contents.
+
+class MappedFile
+{
+    const char* _data;
+    std::size_t _size;
+
+    public:
+
+    explicit MappedFile( const char* filename) : _data(nullptr), _size(0) {
+        int fd = open(filename,O_RDONLY);
+        if( fd < 0 ) throw FileException((std::string("cannot open ") + filename + ": " + std::strerror(errno)).c_str());
+        struct stat st;
+        if( fstat(fd,&st) != 0 ){
+            int err = errno;
+            close(fd);
+            throw FileException((std::string("cannot stat ") + filename + ": " + std::strerror(err)).c_str());
+        }
+        _size = static_cast<std::size_t>(st.st_size);
+        if( _size > 0 ){
+            void* p = mmap(nullptr,_size,PROT_READ,MAP_PRIVATE,fd,0);
+            if( p == MAP_FAILED ){
+                int err = errno;
+                close(fd);
+                throw FileException((std::string("cannot map ") + filename + ": " + std::strerror(err)).c_str());
+            }
+            _data = static_cast<const char*>(p);
+        }
+        close(fd);
+    }
+
+    ~MappedFile(){
+        if( _data != nullptr ) munmap(const_cast<char*>(_data),_size);
+    }
+
+    MappedFile( const MappedFile&) = delete;
+    MappedFile& operator=( const MappedFile&) = delete;
+
+    const char* data() const { return _size ? _data : ""; }
+    std::size_t size() const { return _size; }
+};
+
+inline void load_mmap( lua_State* L, const char* filename){
+    MappedFile file(filename);
+    std::string chunkname = std::string("@") + filename;
+    load_buffer(L,file.data(),file.size(),chunkname.c_str());
+}
+
+// ============================================================================
+// Load from file descriptor
+// The descriptor is read in fixed-size chunks until end of file, so pipes and sockets may be used.
+// It is not closed. As with files, a leading line beginning with '#' is skipped, keeping its newline.
+
+class FdReader
+{
+    enum class State { start, comment, body };
+
+    int _fd;
+    int _error;
+    State _state;
+    char _buffer[65536];
+
+    public:
+
+    explicit FdReader( int fd) : _fd(fd), _error(0), _state(State::start) {}
+
+    int error() const { return _error; }
+
+    static const char* read( lua_State*, void* ud, std::size_t* size){
+        FdReader* self = static_cast<FdReader*>(ud);
+        while( true ){
+            ssize_t n;
+            do {
+                n = ::read(self->_fd,self->_buffer,sizeof(self->_buffer));
+            } while( n < 0 && errno == EINTR );
+            if( n < 0 ) self->_error = errno;
+            if( n <= 0 ){
+                *size = 0;
+                return nullptr;
+            }
+            const char* data = self->_buffer;
+            std::size_t len = static_cast<std::size_t>(n);
+            if( self->_state == State::start ) self->_state = ( data[0] == '#' ) ? State::comment : State::body;
+            if( self->_state == State::comment ){
+                const char* nl = static_cast<const char*>(std::memchr(data,'\n',len));
+                if( nl == nullptr ) continue; // Whole chunk lies within the comment
+                len -= static_cast<std::size_t>(nl-data);
+                data = nl;
+                self->_state = State::body;
+            }
+            *size = len;
+            return data;
+        }
+    }
+};
+
+inline void load_fd( lua_State* L, int fd, const char* chunkname){
+    std::unique_ptr<FdReader> reader(new FdReader(fd));
+    int status = lua_load(L,FdReader::read,reader.get(),chunkname,nullptr);
+    if( reader->error() ){
+        lua_pop(L,1); // Either the chunk or an error message
+        throw FileException((std::string("cannot read ") + chunkname + ": " + std::strerror(reader->error())).c_str());
+    }
+    run_chunk(L,status);
+}
+
+// Read whole file into string, return false on failure
+inline bool read_file( const char* filename, std::string& contents){
+    FILE* f = std::fopen(filename,"rb");
+    if( f == nullptr ) return false;
+    char buffer[65536];
+    std::size_t n;
+    contents.clear();
+    while( (n = std::fread(buffer,1,sizeof(buffer),f)) > 0 ) contents.append(buffer,n);
+    bool ok = !std::ferror(f);
+    std::fclose(f);
+    return ok;
+}
+
+// ============================================================================
+// Bytecode cache
+
+class BytecodeCache
+{
+    private:
+
+    std::string _dir;
+
+    // Written at the start of each cache file, followed by the source path and the bytecode
+    struct Header {
+        char magic[8];
+        std::uint64_t mtime;
+        std::uint64_t size;
+        std::uint64_t hash;
+        std::uint64_t path_size;
+    };
+
+    static const char* magic(){ return "LCFGBC1"; }
+
+    static const char* suffix(){ return ".lcfgbc"; }
+
+    static int dump_writer( lua_State*, const void* p, std::size_t size, void* ud){
+        static_cast<std::string*>(ud)->append(static_cast<const char*>(p),size);
+        return 0;
+    }
+
+    public:
+
+    // ====================================================
+    // Constructors
+    // By default, cache files are placed next to their source with the suffix '.lcfgbc', as in
+    // 'config.lua' -> 'config.lua.lcfgbc'. The suffix is not used by luac or any other tool, so
+    // compiled chunks belonging to the user are never overwritten. Otherwise, they are placed in
+    // the given directory, which must already exist.
+
+    BytecodeCache() {}
+
+    explicit BytecodeCache( const std::string& dir) : _dir(dir) {}
+
+    // ====================================================
+    // Location of cache for a given source file
+
+    std::string cache_path( const char* filename) const {
+        if( _dir.empty() ) return std::string(filename) + suffix();
+        char name[32];
+        std::snprintf(name,sizeof(name),"%016llx",static_cast<unsigned long long>(fnv1a(filename,std::strlen(filename))));
+        return _dir + "/" + name + suffix();
+    }
+
+    // ====================================================
+    // Load file, using cached bytecode where valid
+
+    void load( lua_State* L, const char* filename) const {
+        // Read source. On failure, let Lua report the problem.
+        struct stat st;
+        std::string source;
+        if( stat(filename,&st) != 0 || !read_file(filename,source) ) return load_file(L,filename);
+        std::string chunkname = std::string("@") + filename;
+        // As with luaL_loadfile, skip a leading '#' line but keep its newline
+        std::size_t skip = comment_length(source.data(),source.size());
+        // A precompiled chunk is run as it is, as without a cache, and is not cached again
+        if( skip < source.size() && source[skip] == LUA_SIGNATURE[0] ){
+            return run_chunk(L,luaL_loadbufferx(L,source.data()+skip,source.size()-skip,chunkname.c_str(),nullptr));
+        }
+        Header header;
+        std::memset(&header,0,sizeof(header));
+        std::memcpy(header.magic,magic(),sizeof(header.magic));
+        header.mtime = static_cast<std::uint64_t>(st.st_mtime);
+        header.size = static_cast<std::uint64_t>(source.size());
+        header.hash = fnv1a(source.data(),source.size());
+        header.path_size = std::strlen(filename);
+        std::string path = cache_path(filename);
+        // Attempt to load from cache
+        std::string cached;
+        if( read_file(path.c_str(),cached) && cached.size() >= sizeof(Header)+header.path_size
+            && std::memcmp(cached.data(),&header,sizeof(Header)) == 0
+            && cached.compare(sizeof(Header),header.path_size,filename) == 0 )
+        {
+            std::size_t offset = sizeof(Header)+header.path_size;
+            if( luaL_loadbufferx(L,cached.data()+offset,cached.size()-offset,chunkname.c_str(),"b") == LUA_OK ){
+                return run_chunk(L,LUA_OK);
+            }
+            lua_pop(L,1); // Stale or incompatible bytecode; fall through and recompile
+        }
+        // Compile source
+        int status = luaL_loadbufferx(L,source.data()+skip,source.size()-skip,chunkname.c_str(),nullptr);
+        if( status == LUA_OK ){
+            // Write new cache to temporary file, then move into place
+            std::string bytecode(reinterpret_cast<const char*>(&header),sizeof(Header));
+            bytecode.append(filename,header.path_size);
+            lua_dump(L,dump_writer,&bytecode,0);
+            std::string tmp = path + "." + std::to_string(getpid()) + ".tmp";
+            FILE* f = std::fopen(tmp.c_str(),"wb");
+            if( f != nullptr ){
+                bool ok = std::fwrite(bytecode.data(),1,bytecode.size(),f) == bytecode.size();
+                ok = (std::fclose(f) == 0) && ok;
+                if( !ok || std::rename(tmp.c_str(),path.c_str()) != 0 ) std::remove(tmp.c_str());
+            }
+        }
+        run_chunk(L,status);
+    }
+};
+
+} // end namespace
+#endif
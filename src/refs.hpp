@@ -0,0 +1,93 @@
+// refs.hpp
+//
+// Functions for managing registry references for luaconfig.
+// Setting and Function objects do not hold a Lua State of their own. Instead, they hold a reference
+// to a table or function stored in the registry, and push it to the top of the owning Lua State's
+// stack only for as long as it takes to perform an operation.
+//
+// References created here are counted as live handles by the Lua State's Allocator, if it has one.
+
+#ifndef __LUACONFIG_REFS_HPP
+#define __LUACONFIG_REFS_HPP
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+#include "allocators.hpp"
+
+namespace luaconfig {
+
+// Pop top of stack into the registry, return reference
+inline int new_ref( lua_State* L){
+    int ref = luaL_ref(L,LUA_REGISTRYINDEX);
+    if( ref != LUA_REFNIL ) Allocator::add_handle(L);
+    return ref;
+}
+
+// Push referenced object to top of stack
+inline void push_ref( lua_State* L, int ref){
+    lua_rawgeti(L,LUA_REGISTRYINDEX,ref);
+}
+
+// Create new reference to the same object
+inline int copy_ref( lua_State* L, int ref){
+    push_ref(L,ref);
+    return new_ref(L);
+}
+
+// Pop top of stack, replacing the referenced object
+inline void replace_ref( lua_State* L, int ref){
+    lua_rawseti(L,LUA_REGISTRYINDEX,ref);
+}
+
+// Release reference, allowing the object to be garbage collected
+inline void free_ref( lua_State* L, int ref){
+    if( ref >= 0 ) Allocator::remove_handle(L);
+    luaL_unref(L,LUA_REGISTRYINDEX,ref);
+}
+
+// Restore the stack to its original size on destruction
+class StackGuard
+{
+    lua_State* _L;
+    int _top;
+
+    public:
+
+    explicit StackGuard( lua_State* L) : _L(L), _top(lua_gettop(L)) {}
+
+    ~StackGuard(){
+        lua_settop(_L,_top);
+    }
+
+    StackGuard( const StackGuard&) = delete;
+    StackGuard& operator=( const StackGuard&) = delete;
+};
+
+// Push referenced object for the lifetime of the guard
+// On destruction, the stack is restored to its original size. This also clears anything left behind
+// if an exception is thrown part way through an operation.
+class RefGuard
+{
+    lua_State* _L;
+    int _top;
+
+    public:
+
+    RefGuard( lua_State* L, int ref) : _L(L), _top(lua_gettop(L)) {
+        push_ref(L,ref);
+    }
+
+    ~RefGuard(){
+        lua_settop(_L,_top);
+    }
+
+    RefGuard( const RefGuard&) = delete;
+    RefGuard& operator=( const RefGuard&) = delete;
+};
+
+} //end namespace
+#endif
@@ -0,0 +1,483 @@
+// serialize.hpp
+//
+// Writing Lua values back out as Lua source.
+//
+// Config::dump writes the global scope as a chunk of assignments, and Setting::dump writes a table
+// as a table constructor. Either may be written to a FILE*, a file descriptor, or appended to a
+// std::string. Output is produced in a single pass through a fixed-size buffer, and handed to the
+// destination whenever the buffer fills, so no string is built for the whole of the output.
+//
+// The output is canonical: the same contents always give the same text, whatever order Lua holds
+// them in. Elements 1,2,3... up to the first nil are written in order, without keys. Any other keys
+// follow, sorted with numbers first, then booleans, then strings. String keys that are valid Lua
+// names are written as name = value. Floats are written with 17 significant digits, so are read
+// back exactly, and infinities and NaN are written as expressions.
+//
+// Functions, userdata and threads cannot be written, and are skipped. Where they appear among the
+// ordered elements, nil is written in their place to keep the positions of the elements after
+// them. Tables shared between several keys are written once for each. A table that contains itself
+// throws a SerializeException.
+//
+// Memory use is bounded by the nesting depth, and by the number of keys in a single table outside
+// of its ordered elements, which must be collected to be sorted. Large arrays are written without
+// collecting anything.
+//
+// When writing the global scope, _G, _VERSION, and the standard libraries are left out.
+
+#ifndef __LUACONFIG_SERIALIZE_HPP
+#define __LUACONFIG_SERIALIZE_HPP
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+}
+
+#include "exceptions.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace luaconfig {
+
+// ============================================================================
+// Destinations
+
+class Sink
+{
+    public:
+    virtual ~Sink() {}
+    virtual void write( const char* data, std::size_t size) = 0;
+};
+
+class FileSink : public Sink
+{
+    std::FILE* _file;
+
+    public:
+
+    explicit FileSink( std::FILE* file) : _file(file) {}
+
+    void write( const char* data, std::size_t size) override {
+        if( size != 0 && std::fwrite(data,1,size,_file) != size ){
+            throw FileException((std::string("cannot write Lua source: ") + std::strerror(errno)).c_str());
+        }
+    }
+};
+
+class FdSink : public Sink
+{
+    int _fd;
+
+    public:
+
+    explicit FdSink( int fd) : _fd(fd) {}
+
+    void write( const char* data, std::size_t size) override {
+        while( size != 0 ){
+            ssize_t n = ::write(_fd,data,size);
+            if( n < 0 ){
+                if( errno == EINTR ) continue;
+                throw FileException((std::string("cannot write Lua source: ") + std::strerror(errno)).c_str());
+            }
+            data += n;
+            size -= static_cast<std::size_t>(n);
+        }
+    }
+};
+
+class StringSink : public Sink
+{
+    std::string& _out;
+
+    public:
+
+    explicit StringSink( std::string& out) : _out(out) {}
+
+    void write( const char* data, std::size_t size) override {
+        _out.append(data,size);
+    }
+};
+
+// ============================================================================
+// Serializer
+
+class Serializer
+{
+    static const std::size_t buffer_size = 1 << 16;
+    static const int indent_width = 4;
+
+    lua_State* _L;
+    Sink& _sink;
+    int _top;                        // Stack restored on destruction
+    std::vector<char> _buffer;
+    std::size_t _used;
+    std::vector<const void*> _tables; // Tables being written, outermost first
+
+    // Key of a table, other than an ordered element
+    struct Key {
+        int type;         // LUA_TNUMBER, LUA_TBOOLEAN or LUA_TSTRING
+        bool is_integer;
+        lua_Integer i;    // integer, or boolean
+        lua_Number n;
+        const char* s;    // held by the table for as long as it is unchanged
+        std::size_t len;
+    };
+
+    // ====================================================
+    // Output buffer
+
+    void flush(){
+        if( _used != 0 ) _sink.write(_buffer.data(),_used);
+        _used = 0;
+    }
+
+    // Ensure n bytes are free
+    void reserve( std::size_t n){
+        if( _used + n > buffer_size ) flush();
+    }
+
+    void put( char c){
+        reserve(1);
+        _buffer[_used++] = c;
+    }
+
+    void put( const char* data, std::size_t size){
+        if( size > buffer_size/2 ){
+            flush();
+            _sink.write(data,size);
+            return;
+        }
+        reserve(size);
+        std::memcpy(_buffer.data()+_used,data,size);
+        _used += size;
+    }
+
+    void put( const char* str){
+        put(str,std::strlen(str));
+    }
+
+    void indent( int depth){
+        for( int i=0; i<depth*indent_width; ++i) put(' ');
+    }
+
+    // ====================================================
+    // Scalars
+
+    void write_integer( lua_Integer i){
+        if( i == std::numeric_limits<lua_Integer>::min() ){
+            // Not a valid literal, as its magnitude is out of range
+            put('(');
+            write_integer(i+1);
+            put("-1)");
+            return;
+        }
+        reserve(32);
+        _used += static_cast<std::size_t>(std::snprintf(_buffer.data()+_used,32,"%" PRId64,static_cast<std::int64_t>(i)));
+    }
+
+    void write_number( lua_Number d){
+        if( std::isnan(d) ) return put("(0/0)");
+        if( std::isinf(d) ) return put( d > 0 ? "(1/0)" : "(-1/0)");
+        reserve(40);
+        char* start = _buffer.data()+_used;
+        std::size_t n = static_cast<std::size_t>(std::snprintf(start,32,"%.17g",static_cast<double>(d)));
+        // Keep floats distinct from integers
+        if( start[std::strspn(start,"-0123456789")] == '\0' ){
+            start[n++] = '.';
+            start[n++] = '0';
+        }
+        _used += n;
+    }
+
+    void write_string( const char* s, std::size_t len){
+        put('"');
+        const char* end = s+len;
+        while( s != end ){
+            // Copy run of characters needing no escape
+            const char* run = s;
+            while( s != end && static_cast<unsigned char>(*s) >= 32 && *s != 127 && *s != '"' && *s != '\\' ) ++s;
+            if( s != run ) put(run,static_cast<std::size_t>(s-run));
+            if( s == end ) break;
+            switch( *s ){
+                case '"':  put("\\\"",2); break;
+                case '\\': put("\\\\",2); break;
+                case '\n': put("\\n",2); break;
+                case '\r': put("\\r",2); break;
+                case '\t': put("\\t",2); break;
+                default:
+                    // Three digits, so that a following digit is not taken as part of the escape
+                    reserve(5);
+                    _used += static_cast<std::size_t>(std::snprintf(_buffer.data()+_used,5,"\\%03d",static_cast<unsigned char>(*s)));
+            }
+            ++s;
+        }
+        put('"');
+    }
+
+    static bool is_name( const char* s, std::size_t len){
+        static const char* const reserved[] = {
+            "and", "break", "do", "else", "elseif", "end", "false", "for", "function", "goto", "if",
+            "in", "local", "nil", "not", "or", "repeat", "return", "then", "true", "until", "while"
+        };
+        if( len == 0 || (s[0] >= '0' && s[0] <= '9') ) return false;
+        for( std::size_t i=0; i<len; ++i){
+            char c = s[i];
+            if( !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_') ) return false;
+        }
+        for( const char* word : reserved){
+            if( std::strlen(word) == len && std::memcmp(word,s,len) == 0 ) return false;
+        }
+        return true;
+    }
+
+    // ====================================================
+    // Keys
+
+    static bool is_writable( int type){
+        return type == LUA_TBOOLEAN || type == LUA_TNUMBER || type == LUA_TSTRING || type == LUA_TTABLE;
+    }
+
+    // Numbers, then booleans, then strings
+    static int rank( int type){
+        return ( type == LUA_TNUMBER ) ? 0 : ( type == LUA_TBOOLEAN ) ? 1 : 2;
+    }
+
+    static bool key_less( const Key& a, const Key& b){
+        if( a.type != b.type ) return rank(a.type) < rank(b.type);
+        if( a.type == LUA_TSTRING ){
+            int cmp = std::memcmp(a.s,b.s,std::min(a.len,b.len));
+            return cmp != 0 ? cmp < 0 : a.len < b.len;
+        }
+        if( a.type == LUA_TBOOLEAN ) return a.i < b.i;
+        if( a.is_integer && b.is_integer ) return a.i < b.i;
+        lua_Number x = a.is_integer ? static_cast<lua_Number>(a.i) : a.n;
+        lua_Number y = b.is_integer ? static_cast<lua_Number>(b.i) : b.n;
+        return x != y ? x < y : a.is_integer > b.is_integer;
+    }
+
+    // Collect keys of table at index t, other than elements 1..n, whose values can be written
+    std::vector<Key> collect_keys( int t, lua_Integer n){
+        std::vector<Key> keys;
+        lua_pushnil(_L);
+        while( lua_next(_L,t) ){
+            int value_type = lua_type(_L,-1);
+            lua_pop(_L,1);
+            if( !is_writable(value_type) ) continue;
+            Key key{ lua_type(_L,-1), false, 0, 0, nullptr, 0};
+            switch( key.type ){
+                case LUA_TNUMBER:
+                    key.is_integer = lua_isinteger(_L,-1);
+                    if( key.is_integer ){
+                        key.i = lua_tointeger(_L,-1);
+                        if( key.i >= 1 && key.i <= n ) continue;
+                    } else {
+                        key.n = lua_tonumber(_L,-1);
+                    }
+                    break;
+                case LUA_TBOOLEAN:
+                    key.i = lua_toboolean(_L,-1);
+                    break;
+                case LUA_TSTRING:
+                    // Read in place. lua_tolstring does not convert, as the key is a string.
+                    key.s = lua_tolstring(_L,-1,&key.len);
+                    break;
+                default:
+                    continue;
+            }
+            keys.push_back(key);
+        }
+        std::sort(keys.begin(),keys.end(),&Serializer::key_less);
+        return keys;
+    }
+
+    static bool key_is( const Key& key, const char* name){
+        return key.len == std::strlen(name) && std::memcmp(key.s,name,key.len) == 0;
+    }
+
+    void push_key( const Key& key){
+        switch( key.type ){
+            case LUA_TNUMBER:
+                if( key.is_integer ) lua_pushinteger(_L,key.i);
+                else lua_pushnumber(_L,key.n);
+                break;
+            case LUA_TBOOLEAN:
+                lua_pushboolean(_L,static_cast<int>(key.i));
+                break;
+            default:
+                lua_pushlstring(_L,key.s,key.len);
+        }
+    }
+
+    // Write key in brackets
+    void write_bracketed( const Key& key){
+        put('[');
+        switch( key.type ){
+            case LUA_TNUMBER:
+                if( key.is_integer ) write_integer(key.i);
+                else write_number(key.n);
+                break;
+            case LUA_TBOOLEAN:
+                put( key.i ? "true" : "false");
+                break;
+            default:
+                write_string(key.s,key.len);
+        }
+        put(']');
+    }
+
+    // ====================================================
+    // Values
+
+    // Write value on top of stack, which is popped
+    void write_value( int depth){
+        switch( lua_type(_L,-1) ){
+            case LUA_TBOOLEAN:
+                put( lua_toboolean(_L,-1) ? "true" : "false");
+                break;
+            case LUA_TNUMBER:
+                if( lua_isinteger(_L,-1) ) write_integer(lua_tointeger(_L,-1));
+                else write_number(lua_tonumber(_L,-1));
+                break;
+            case LUA_TSTRING: {
+                std::size_t len;
+                const char* s = lua_tolstring(_L,-1,&len);
+                write_string(s,len);
+                break;
+            }
+            case LUA_TTABLE:
+                write_table(depth);
+                break;
+            default:
+                put("nil");
+        }
+        lua_pop(_L,1);
+    }
+
+    void write_table( int depth){
+        const void* ptr = lua_topointer(_L,-1);
+        if( std::find(_tables.begin(),_tables.end(),ptr) != _tables.end() ){
+            throw SerializeException("cannot write Lua source for a table that contains itself");
+        }
+        if( !lua_checkstack(_L,4) ) throw SerializeException("cannot write Lua source: tables nested too deeply");
+        _tables.push_back(ptr);
+        int t = lua_gettop(_L);
+        bool empty = true;
+        put('{');
+        // Ordered elements
+        lua_Integer n = 0;
+        while( lua_rawgeti(_L,t,n+1) != LUA_TNIL ){
+            put('\n');
+            indent(depth+1);
+            write_value(depth+1);
+            put(',');
+            empty = false;
+            ++n;
+        }
+        lua_pop(_L,1);
+        // Other keys
+        for( auto&& key : collect_keys(t,n)){
+            push_key(key);
+            lua_rawget(_L,t);
+            put('\n');
+            indent(depth+1);
+            if( key.type == LUA_TSTRING && is_name(key.s,key.len) ){
+                put(key.s,key.len);
+            } else {
+                write_bracketed(key);
+            }
+            put(" = ");
+            write_value(depth+1);
+            put(',');
+            empty = false;
+        }
+        if( !empty ){
+            put('\n');
+            indent(depth);
+        }
+        put('}');
+        _tables.pop_back();
+    }
+
+    public:
+
+    Serializer( lua_State* L, Sink& sink) : _L(L), _sink(sink), _top(lua_gettop(L)), _buffer(buffer_size), _used(0) {}
+
+    ~Serializer(){
+        lua_settop(_L,_top);
+    }
+
+    Serializer( const Serializer&) = delete;
+    Serializer& operator=( const Serializer&) = delete;
+
+    // Write table on top of stack as a table constructor. The table is not popped.
+    void table(){
+        lua_pushvalue(_L,-1);
+        write_value(0);
+        put('\n');
+        flush();
+    }
+
+    // Write global scope as assignments, one per line
+    void globals(){
+        lua_pushglobaltable(_L);
+        int g = lua_gettop(_L);
+        lua_getfield(_L,LUA_REGISTRYINDEX,"_LOADED");
+        int loaded = lua_gettop(_L);
+        _tables.push_back(lua_topointer(_L,g));
+        for( auto&& key : collect_keys(g,0)){
+            if( key.type == LUA_TSTRING && ( key_is(key,"_G") || key_is(key,"_VERSION") ) ) continue;
+            push_key(key);
+            lua_rawget(_L,g);
+            // Skip other references to the global table
+            if( lua_rawequal(_L,-1,g) ){
+                lua_pop(_L,1);
+                continue;
+            }
+            // Skip standard libraries, and anything else loaded by require
+            if( key.type == LUA_TSTRING && lua_istable(_L,loaded) ){
+                lua_getfield(_L,loaded,key.s);
+                bool library = lua_rawequal(_L,-1,-2);
+                lua_pop(_L,1);
+                if( library ){
+                    lua_pop(_L,1);
+                    continue;
+                }
+            }
+            if( key.type == LUA_TSTRING && is_name(key.s,key.len) ){
+                put(key.s,key.len);
+            } else {
+                put("_ENV");
+                write_bracketed(key);
+            }
+            put(" = ");
+            write_value(0);
+            put('\n');
+        }
+        _tables.pop_back();
+        lua_settop(_L,g-1);
+        flush();
+    }
+};
+
+// ============================================================================
+// Convenience functions
+
+inline void serialize_table( lua_State* L, Sink& sink){
+    Serializer(L,sink).table();
+}
+
+inline void serialize_globals( lua_State* L, Sink& sink){
+    Serializer(L,sink).globals();
+}
+
+} // end namespace
+#endif
@@ -0,0 +1,218 @@
+// stats.hpp
+//
+// Optional instrumentation of luaconfig's hot paths.
+//
+// When compiled with LUACONFIG_INSTRUMENT defined, each Config records:
+//     - the number of lookups of each key, and a histogram of key depth (number of dot-separated tokens)
+//     - calls to get with a default, split by whether the variable was missing or of the wrong type
+//     - Setting creations and destructions
+//     - latency histograms for read, lua_to_stack and Function calls, with each Function::map
+//       recorded separately as one batch
+// These are returned by Config::stats(), and may be written out as text with Stats::dump().
+//
+// Without LUACONFIG_INSTRUMENT, the instrumentation macros expand to nothing, and Config::stats()
+// returns a Stats object that is always empty.
+//
+// The key counts are a guide to which keys are worth precompiling as Paths, or moving into a
+// Snapshot. Counting them involves a registry lookup, a clock read and a hash table update per
+// operation, so instrumented builds are noticeably slower.
+
+#ifndef __LUACONFIG_STATS_HPP
+#define __LUACONFIG_STATS_HPP
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+#include "Path.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace luaconfig {
+
+// ============================================================================
+// Latency histogram
+// Bucket i counts events taking [2^i, 2^(i+1)) nanoseconds.
+
+struct Histogram
+{
+    static const std::size_t n_buckets = 40;
+
+    std::size_t count = 0;
+    std::uint64_t total_ns = 0;
+    std::array<std::size_t,n_buckets> buckets{};
+
+    void add( std::uint64_t ns){
+        std::size_t bucket = 0;
+        while( bucket+1 < n_buckets && (ns >> (bucket+1)) != 0 ) ++bucket;
+        ++buckets[bucket];
+        ++count;
+        total_ns += ns;
+    }
+
+    double mean_ns() const {
+        return count ? static_cast<double>(total_ns)/count : 0.0;
+    }
+};
+
+// ============================================================================
+// Statistics for one Config
+
+struct Stats
+{
+    std::unordered_map<std::string,std::size_t> lookups; // Lookups of each key
+    std::vector<std::size_t> depth;                      // Lookups by number of tokens in key
+    std::size_t default_missing = 0;                     // get with default, variable missing
+    std::size_t default_mismatch = 0;                    // get with default, variable of wrong type
+    std::size_t settings_created = 0;
+    std::size_t settings_destroyed = 0;
+    Histogram read;
+    Histogram lookup;
+    Histogram function_call;
+    Histogram function_map;                              // Whole batches, kept apart from single calls
+
+    void count_lookup( const std::string& key, std::size_t n_tokens){
+        ++lookups[key];
+        if( depth.size() <= n_tokens ) depth.resize(n_tokens+1,0);
+        ++depth[n_tokens];
+    }
+
+    // Write human-readable summary
+    // Keys are listed most frequent first, up to max_keys of them.
+    void dump( std::ostream& os, std::size_t max_keys = 20) const {
+        std::vector<std::pair<std::string,std::size_t>> keys(lookups.begin(),lookups.end());
+        std::sort(keys.begin(),keys.end(),[](const std::pair<std::string,std::size_t>& a, const std::pair<std::string,std::size_t>& b){
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+        os << "lookups by key:\n";
+        for( std::size_t i=0; i<keys.size() && i<max_keys; ++i) os << "  " << keys[i].first << ' ' << keys[i].second << '\n';
+        if( keys.size() > max_keys ) os << "  (" << keys.size()-max_keys << " more)\n";
+        os << "lookups by depth:\n";
+        for( std::size_t i=0; i<depth.size(); ++i) if( depth[i] ) os << "  " << i << ' ' << depth[i] << '\n';
+        os << "defaults used: missing " << default_missing << ", mismatch " << default_mismatch << '\n';
+        os << "settings: created " << settings_created << ", destroyed " << settings_destroyed << '\n';
+        dump_histogram(os,"read",read);
+        dump_histogram(os,"lua_to_stack",lookup);
+        dump_histogram(os,"function call",function_call);
+        dump_histogram(os,"function map",function_map);
+    }
+
+    private:
+
+    static void dump_histogram( std::ostream& os, const char* name, const Histogram& h){
+        os << name << ": " << h.count << " calls, mean " << h.mean_ns() << " ns\n";
+        for( std::size_t i=0; i<Histogram::n_buckets; ++i){
+            if( h.buckets[i] ) os << "  <" << (std::uint64_t(2) << i) << " ns " << h.buckets[i] << '\n';
+        }
+    }
+};
+
+// ============================================================================
+// Access from Lua State
+// Each Config places a pointer to its Stats in the registry, under a light userdata key.
+
+inline const void* stats_key(){
+    static const char key = 0;
+    return &key;
+}
+
+inline void register_stats( lua_State* L, Stats* stats){
+    lua_pushlightuserdata(L,stats);                      // +1, [s]
+    lua_rawsetp(L,LUA_REGISTRYINDEX,stats_key());        // +0, [], R[key] = s
+}
+
+// Stats of Lua State, or nullptr if none were registered
+inline Stats* stats_of( lua_State* L){
+    lua_rawgetp(L,LUA_REGISTRYINDEX,stats_key());        // +1, [s]
+    Stats* stats = static_cast<Stats*>(lua_touserdata(L,-1));
+    lua_pop(L,1);                                        // +0, []
+    return stats;
+}
+
+// Record lookup of key
+inline std::size_t key_depth( const char* key){
+    const char* tk;
+    std::size_t len, n = 0;
+    while( next_token(key,tk,len) ) ++n;
+    return n;
+}
+
+inline void record_lookup( lua_State* L, const char* key){
+    if( Stats* stats = stats_of(L) ) stats->count_lookup(key,key_depth(key));
+}
+
+inline void record_lookup( lua_State* L, const Path& key){
+    if( Stats* stats = stats_of(L) ) stats->count_lookup(key.str(),key.size());
+}
+
+inline void record_lookup( lua_State* L, const Path& key, std::size_t n_tokens){
+    if( n_tokens == key.size() ) return record_lookup(L,key);
+    std::string prefix;
+    for( std::size_t i=0; i<n_tokens; ++i) prefix += (i ? "." : "") + key[i].key;
+    if( Stats* stats = stats_of(L) ) stats->count_lookup(prefix,n_tokens);
+}
+
+inline void record_lookup( lua_State* L, lua_Integer key){
+    if( Stats* stats = stats_of(L) ) stats->count_lookup("[" + std::to_string(key) + "]",1);
+}
+
+// Record use of a default, according to whether the value on top of the stack is missing or
+// of the wrong type
+inline void record_default( lua_State* L){
+    if( Stats* stats = stats_of(L) ) ++( lua_isnoneornil(L,-1) ? stats->default_missing : stats->default_mismatch );
+}
+
+// Time the enclosing scope
+class ScopedTimer
+{
+    Histogram* _histogram;
+    std::chrono::steady_clock::time_point _start;
+
+    public:
+
+    ScopedTimer( lua_State* L, Histogram Stats::* field) : _histogram(nullptr) {
+        if( Stats* stats = stats_of(L) ){
+            _histogram = &(stats->*field);
+            _start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedTimer(){
+        if( _histogram == nullptr ) return;
+        auto elapsed = std::chrono::steady_clock::now() - _start;
+        _histogram->add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+    ScopedTimer( const ScopedTimer&) = delete;
+    ScopedTimer& operator=( const ScopedTimer&) = delete;
+};
+
+} // end namespace
+
+// ============================================================================
+// Instrumentation macros
+
+#ifdef LUACONFIG_INSTRUMENT
+#define LUACONFIG_RECORD_LOOKUP(L,...) luaconfig::record_lookup(L,__VA_ARGS__)
+#define LUACONFIG_TIME(L,field) luaconfig::ScopedTimer luaconfig_timer_##field(L,&luaconfig::Stats::field)
+#define LUACONFIG_COUNT(L,field) do{ if( luaconfig::Stats* s_ = luaconfig::stats_of(L) ) ++s_->field; }while(0)
+#define LUACONFIG_COUNT_DEFAULT(L) luaconfig::record_default(L)
+#else
+#define LUACONFIG_RECORD_LOOKUP(L,...) ((void)0)
+#define LUACONFIG_TIME(L,field) ((void)0)
+#define LUACONFIG_COUNT(L,field) ((void)0)
+#define LUACONFIG_COUNT_DEFAULT(L) ((void)0)
+#endif
+
+#endif
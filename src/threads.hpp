@@ -3,6 +3,17 @@
 // Functions for managing threads for luaconfig.
 // Luaconfig does not use mutliple threads for the purpose of multi-tasking.
 // Instead, they are used to generate new Lua States with separate execution stacks.
+//
+// Threads are handed out by a pool living in the registry. Released threads are not left to the
+// garbage collector, but are kept in the pool and reused by the next request. Free slots are held
+// on a stack, so both acquiring and releasing a thread cost a fixed number of raw table accesses,
+// regardless of how many threads are currently alive.
+//
+// Pool layout (all keys are integers, accessed with raw gets/sets):
+//     P[1..size]       threads, live or free
+//     P[0]             size, the number of threads ever created
+//     P[-1]            n_free, the number of free threads
+//     P[-2..-1-n_free] stack of free thread ids
 
 #ifndef __LUACONFIG_THREADS_HPP
 #define __LUACONFIG_THREADS_HPP
@@ -14,47 +25,77 @@ extern "C" {
 }
 
 #include "exceptions.hpp"
+#include <cstddef>
 #include <tuple>
 #include <utility>
 
 namespace luaconfig {
 
-// Name of thread pool
-static const char* thread_pool = "luaconfigthreadpool";
+// Registry key of thread pool
+// The address of a function-local static is unique throughout the program, so it may be used as a
+// light userdata key. This avoids hashing a string key each time the pool is looked up.
+inline const void* thread_pool_key(){
+    static const char key = 0;
+    return &key;
+}
 
-// create new thread, place in registry, return pointer to lua_State and id
-inline std::pair<lua_State*,int> new_thread( lua_State* L){
-    // Side notes follow stack. R=Registry, T=ThreadTable, k=key, t=thread
-    // Lookup thread table
-    lua_pushstring(L,thread_pool);                       // +1, [k], add key to stack
-    lua_gettable(L,LUA_REGISTRYINDEX);                   // +1, [T], pop string, push T = R[k]
-    // If not found, create
-    if( !lua_istable(L,-1) ){
+// Indices of pool counters
+static const lua_Integer thread_pool_size = 0;
+static const lua_Integer thread_pool_n_free = -1;
+
+// Push thread pool to top of stack, creating it if necessary
+inline void push_thread_pool( lua_State* L){
+    // Side notes follow stack. R=Registry, P=ThreadPool
+    if( lua_rawgetp(L,LUA_REGISTRYINDEX,thread_pool_key()) != LUA_TTABLE ){ // +1, [P], P = R[key]
         lua_pop(L,1);                                    // +0, [],  pop whatever was found
-        lua_pushstring(L,thread_pool);                   // +1, [k], push key
-        lua_newtable(L);                                 // +2, [k,T], push new table
-        lua_settable(L,LUA_REGISTRYINDEX);               // +0, [], set R[k] = T, pop k and T
-        lua_pushstring(L,thread_pool);                   // +1, [k], add key to stack
-        lua_gettable(L,LUA_REGISTRYINDEX);               // +1, [T], pop string, push T = R[k]
+        lua_newtable(L);                                 // +1, [P], push new table
+        lua_pushinteger(L,0);                            // +2, [P,0]
+        lua_rawseti(L,-2,thread_pool_size);              // +1, [P], P[0] = 0
+        lua_pushinteger(L,0);                            // +2, [P,0]
+        lua_rawseti(L,-2,thread_pool_n_free);            // +1, [P], P[-1] = 0
+        lua_pushvalue(L,-1);                             // +2, [P,P]
+        lua_rawsetp(L,LUA_REGISTRYINDEX,thread_pool_key()); // +1, [P], R[key] = P
     }
-    // With thread table on top of stack, find first nil
-    int id=1;
-    while(true){
-        lua_pushnumber(L,id);                            // +2, [T,id], push id
-        lua_gettable(L,-2);                              // +2, [T,v], with v = T[id]
-        bool is_nil = lua_isnil(L,-1);                   // +2, [T,v]
-        lua_pop(L,1);                                    // +1, [T], pop v
-        if( is_nil ) break; else ++id;
+}
+
+// Read integer counter from pool on top of stack
+inline lua_Integer get_pool_counter( lua_State* L, lua_Integer idx){
+    lua_rawgeti(L,-1,idx);                               // +1, [P,c]
+    lua_Integer result = lua_tointeger(L,-1);
+    lua_pop(L,1);                                        // +0, [P]
+    return result;
+}
+
+// Write integer counter to pool on top of stack
+inline void set_pool_counter( lua_State* L, lua_Integer idx, lua_Integer value){
+    lua_pushinteger(L,value);                            // +1, [P,c]
+    lua_rawseti(L,-2,idx);                               // +0, [P], P[idx] = c
+}
+
+// Get thread from pool, place in registry, return pointer to lua_State and id
+// Reuses a previously released thread if one is available.
+inline std::pair<lua_State*,int> new_thread( lua_State* L){
+    // Side notes follow stack. P=ThreadPool, t=thread
+    push_thread_pool(L);                                 // +1, [P]
+    int id;
+    lua_Integer n_free = get_pool_counter(L,thread_pool_n_free);
+    if( n_free > 0 ){
+        // Pop id from free stack
+        id = static_cast<int>(get_pool_counter(L,-1-n_free));
+        set_pool_counter(L,thread_pool_n_free,n_free-1);
+        lua_rawgeti(L,-1,id);                            // +2, [P,t], t = P[id]
+    } else {
+        // No free threads, create new one at end of pool
+        id = static_cast<int>(get_pool_counter(L,thread_pool_size)+1);
+        set_pool_counter(L,thread_pool_size,id);
+        lua_newthread(L);                                // +2, [P,t], new thread
+        lua_pushvalue(L,-1);                             // +3, [P,t,t]
+        lua_rawseti(L,-3,id);                            // +2, [P,t], set P[id] = t
     }
-    lua_pushnumber(L,id);                                // +2, [T,id], push id
-    // Create new thread, create pointer
-    lua_newthread(L);                                    // +3, [T,id,t], new thread
-    lua_State* p_thread = lua_tothread(L,-1);            // +3, [T,id,t]
-    // Add thread to thread pool
-    lua_settable(L,-3);                                  // +1, [T], set T[id] = t
+    lua_State* p_thread = lua_tothread(L,-1);            // +2, [P,t]
     // Clean up
-    lua_pop(L,1);                                        // +0, [], pop thread table
-    // Return pointer to new thread and associated id
+    lua_pop(L,2);                                        // +0, [], pop thread and thread pool
+    // Return pointer to thread and associated id
     return std::make_pair(p_thread,id);
 }
 
@@ -73,16 +114,37 @@ inline std::pair<lua_State*,int> copy_thread( lua_State* L){
     return std::make_pair(p_new,id);
 }
 
-// kill a thread by setting its value to nil
+// Return a thread to the pool
+// The thread's stack is emptied, and it is held until the next call to new_thread. L may be the
+// thread being returned. Threads that did not finish cleanly (i.e. they raised an error or were
+// left suspended) cannot be reused, so these are replaced by a fresh thread.
 inline void kill_thread( lua_State* L, int thread_id){
-    // assume thread pool already exists
-    lua_pushstring(L,thread_pool);
-    lua_gettable(L,LUA_REGISTRYINDEX);
-    lua_pushnumber(L,thread_id);
-    lua_pushnil(L);
-    lua_settable(L,-3);
+    // Side notes follow stack. P=ThreadPool, t=thread
+    push_thread_pool(L);                                 // +1, [P]
+    lua_rawgeti(L,-1,thread_id);                         // +2, [P,t], t = P[id]
+    lua_State* p_thread = lua_tothread(L,-1);            // +2, [P,t]
+    lua_pop(L,1);                                        // +1, [P]
+    bool reusable = ( lua_status(p_thread) == LUA_OK );
+    if( !reusable ){
+        lua_newthread(L);                                // +2, [P,t], replacement thread
+        lua_rawseti(L,-2,thread_id);                     // +1, [P], set P[id] = t
+    }
+    // Push id to free stack
+    lua_Integer n_free = get_pool_counter(L,thread_pool_n_free)+1;
+    set_pool_counter(L,-1-n_free,thread_id);
+    set_pool_counter(L,thread_pool_n_free,n_free);
+    lua_pop(L,1);                                        // +0, [], pop thread pool
+    // Clear stack of recycled thread, ready for reuse
+    if( reusable ) lua_settop(p_thread,0);
 }
 
+// Count threads currently handed out by the pool
+inline std::size_t live_threads( lua_State* L){
+    push_thread_pool(L);                                 // +1, [P]
+    lua_Integer live = get_pool_counter(L,thread_pool_size) - get_pool_counter(L,thread_pool_n_free);
+    lua_pop(L,1);                                        // +0, []
+    return static_cast<std::size_t>(live);
+}
 
 } //end namespace
 #endif
@@ -5,11 +5,42 @@
 #ifndef __LUACONFIG_UTILS_HPP
 #define __LUACONFIG_UTILS_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <tuple>
+#include <type_traits>
 #include <functional>
+#include <vector>
 
 namespace luaconfig {
 
+// 64-bit FNV-1a hash of a block of memory
+// Not cryptographic. Used to detect changes, not to guard against tampering.
+inline std::uint64_t fnv1a( const void* data, std::size_t size, std::uint64_t hash = 14695981039346656037ULL){
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for( std::size_t i=0; i<size; ++i){
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Compile-time sequence of indices
+// As std::index_sequence and std::make_index_sequence, which are not available in C++11.
+template<std::size_t... I>
+struct index_sequence {};
+
+template<std::size_t N, std::size_t... I>
+struct make_index_sequence_impl : make_index_sequence_impl<N-1,N-1,I...> {};
+
+template<std::size_t... I>
+struct make_index_sequence_impl<0,I...> {
+    using type = index_sequence<I...>;
+};
+
+template<std::size_t N>
+using make_index_sequence = typename make_index_sequence_impl<N>::type;
+
 // Is type T a std::tuple?
 template<class T>
 struct is_tuple {
@@ -34,6 +65,32 @@ struct is_function<std::function<Arg>> {
     using sig = Arg;
 };
 
+// Is type T a std::vector?
+// Additionally provide element type.
+template<class T>
+struct is_vector {
+    static const bool value = false;
+};
+
+template<class T, class Alloc>
+struct is_vector<std::vector<T,Alloc>> {
+    static const bool value = true;
+    using element = T;
+};
+
+// Is type T a struct bound with LUACONFIG_STRUCT?
+// Bound structs provide a function luaconfig_fields(T*), found by argument-dependent lookup.
+template<class T>
+struct is_bound {
+    template<class U>
+    static auto test(int) -> decltype(luaconfig_fields(static_cast<U*>(nullptr)), std::true_type());
+
+    template<class U>
+    static std::false_type test(...);
+
+    static const bool value = decltype(test<T>(0))::value;
+};
+
 // is_iterable trait class
 // Borrows from Stack Overflow:
 // * jarod42's answer to question 13830158
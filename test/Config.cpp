@@ -8,6 +8,9 @@
 #include <iomanip>
 #include <vector>
 #include <array>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
 
 int main(void)
 {
@@ -130,5 +133,224 @@ int main(void)
         for( auto&& x : vec) std::cout << x << std::endl;       
     }
 
+    // Precompiled paths
+    {
+        luaconfig::Path p("table.table.string");
+        luaconfig::Path q("matrix.2.2");
+        std::cout << cfg.get<std::string>(p) << std::endl;
+        std::cout << cfg.get<double>(q) << std::endl;
+        std::cout << std::boolalpha << cfg.exists(p) << std::endl;
+        std::cout << cfg.len(luaconfig::Path("matrix.1")) << std::endl;
+        std::cout << cfg.get<int>(luaconfig::Path("table.qwerty"),3) << std::endl;
+        luaconfig::Path r("table.table.new");
+        cfg.set(r,12);
+        std::cout << cfg.get<int>(r) << std::endl;
+        // Enclosing tables must exist
+        for( auto&& key : {"table.int.x","missing.table.x"}){
+            try{
+                cfg.set(luaconfig::Path(key),1);
+            } catch( const luaconfig::TypeMismatchException& e){
+                std::cout << e.what() << std::endl;
+            }
+        }
+        // String keys name a single variable, without dot notation
+        cfg.set("table.dotted",5);
+        std::cout << cfg.exists(luaconfig::Path("table.dotted")) << ' ' << cfg.get<int>("table.dotted",-1) << std::endl;
+    }
+
+    // Bulk array reads
+    {
+        auto v = cfg.get<std::vector<double>>("array");
+        for( auto&& x : v) std::cout << x << ' ';
+        std::cout << std::endl;
+        float f[3];
+        cfg.get( "array", f, 3);
+        for( auto&& x : f) std::cout << x << ' ';
+        std::cout << std::endl;
+        auto row = cfg.get<std::vector<float>>("matrix.2");
+        for( auto&& x : row) std::cout << x << ' ';
+        std::cout << std::endl;
+        auto str = cfg.get<std::vector<std::string>>("strings");
+        for( auto&& x : str) std::cout << x << ' ';
+        std::cout << std::endl;
+        auto mat = cfg.get<std::vector<std::vector<double>>>("matrix");
+        std::cout << mat.size() << 'x' << mat[0].size() << std::endl;
+        try{
+            auto s = cfg.get<std::vector<int>>("array");
+        } catch( const luaconfig::TypeMismatchException& e){
+            std::cout << e.what() << std::endl;
+        }
+        try{
+            auto s = cfg.get<std::vector<std::vector<int>>>("matrix");
+        } catch( const luaconfig::TypeMismatchException& e){
+            std::cout << e.what() << std::endl;
+        }
+    }
+
+    // N-dimensional arrays
+    {
+        std::vector<std::size_t> shape;
+        std::vector<double> data;
+        cfg.get_ndarray("matrix",shape,data);
+        std::cout << shape[0] << 'x' << shape[1] << ':';
+        for( auto&& x : data) std::cout << ' ' << x;
+        std::cout << std::endl;
+        std::vector<int> cube;
+        cfg.get_ndarray("cube",shape,cube);
+        std::cout << shape[0] << 'x' << shape[1] << 'x' << shape[2] << ':';
+        for( auto&& x : cube) std::cout << ' ' << x;
+        std::cout << std::endl;
+        try{
+            cfg.get_ndarray("ragged",shape,data);
+        } catch( const luaconfig::ShapeMismatchException& e){
+            std::cout << e.what() << std::endl;
+        }
+        // An empty first row does not hide longer ones
+        auto empty = luaconfig::Config::from_buffer("e = { {}, {} } r = { {}, {1,2} }","ndarray_empty");
+        empty.get_ndarray("e",shape,data);
+        std::cout << shape[0] << 'x' << shape[1] << ' ' << data.size() << std::endl;
+        try{
+            empty.get_ndarray("r",shape,data);
+        } catch( const luaconfig::ShapeMismatchException& e){
+            std::cout << e.what() << std::endl;
+        }
+    }
+
+    // Bytecode cache
+    {
+        luaconfig::BytecodeCache cache;
+        { luaconfig::Config first("test.lua",cache); }  // compiles and writes cache
+        luaconfig::Config second("test.lua",cache);     // loads cached bytecode
+        std::cout << second.get<double>("z") << std::endl;
+        std::remove(cache.cache_path("test.lua").c_str());
+        // Precompiled chunks load as they do without a cache
+        luaconfig::Config::from_buffer("local f = io.open('precompiled.luac','wb') f:write(string.dump(load('w = 6'))) f:close()");
+        luaconfig::Config precompiled("precompiled.luac",cache);
+        std::FILE* f = std::fopen(cache.cache_path("precompiled.luac").c_str(),"rb");
+        std::cout << precompiled.get<int>("w") << " cached " << std::boolalpha << (f != nullptr) << std::endl;
+        if( f != nullptr ) std::fclose(f);
+        std::remove("precompiled.luac");
+    }
+
+    // Other sources
+    {
+        auto mapped = luaconfig::Config::from_mmap("test.lua");
+        std::cout << mapped.get<double>("z") << std::endl;
+        auto buffered = luaconfig::Config::from_buffer("a = 1\nb = { c = 'buffered' }");
+        std::cout << buffered.get<std::string>("b.c") << std::endl;
+        int fd = open("test.lua",O_RDONLY);
+        auto streamed = luaconfig::Config::from_fd(fd,"test.lua");
+        close(fd);
+        std::cout << streamed.get<std::string>("table.string") << std::endl;
+        int fds[2];
+        if( pipe(fds) == 0 ){
+            const char script[] = "#!/usr/bin/env lua\nshebang = 'skipped'\n";
+            ssize_t written = write(fds[1],script,sizeof(script)-1);
+            close(fds[1]);
+            auto piped = luaconfig::Config::from_fd(fds[0],"pipe");
+            close(fds[0]);
+            std::cout << (written > 0) << ' ' << piped.get<std::string>("shebang") << std::endl;
+        }
+        try{
+            luaconfig::Config::from_buffer("a = = 1","bad_buffer");
+        } catch( const luaconfig::FileException& e){
+            std::cout << e.what() << std::endl;
+        }
+    }
+
+    // Allocators
+    {
+        luaconfig::Config pooled("test.lua",std::unique_ptr<luaconfig::Allocator>(new luaconfig::PoolAllocator));
+        std::cout << pooled.get<double>("z") << std::endl;
+        luaconfig::Config arena("test.lua",std::unique_ptr<luaconfig::Allocator>(new luaconfig::ArenaAllocator));
+        std::cout << arena.get<std::string>("table.string") << std::endl;
+        luaconfig::Config budget("test.lua",std::unique_ptr<luaconfig::Allocator>(new luaconfig::BudgetAllocator(1<<20)));
+        std::cout << budget.get<double>("z") << std::endl;
+        try{
+            auto big = luaconfig::Config::from_buffer("t = {} for i=1,1e6 do t[i] = i end","big_buffer",
+                std::unique_ptr<luaconfig::Allocator>(new luaconfig::BudgetAllocator(1<<20)));
+        } catch( const luaconfig::MemoryException& e){
+            std::cout << e.what() << std::endl;
+        }
+    }
+
+    // Memory statistics
+    {
+        auto before = cfg.memory_stats();
+        {
+            auto table = cfg.get<luaconfig::Setting>("table");
+            auto f = cfg.get<luaconfig::Function<double(double)>>("f");
+            std::cout << cfg.memory_stats().live_handles - before.live_handles << std::endl;
+        }
+        auto after = cfg.memory_stats();
+        std::cout << after.live_handles - before.live_handles << std::endl;
+        std::cout << after.bytes << ' ' << after.peak_bytes << ' ' << after.allocations << ' '
+                  << after.gc_bytes << ' ' << after.live_threads << ' ' << after.gc_cycles << std::endl;
+    }
+
+    // Hot-path statistics, only recorded when compiled with -DLUACONFIG_INSTRUMENT
+    {
+        for( int i=0; i<3; ++i) cfg.get<double>("table.float");
+        cfg.get<double>("missing",0.0);
+        cfg.get<double>("table.string",0.0);
+        cfg.stats().dump(std::cout);
+    }
+
+    // Key cache
+    {
+        auto cached = luaconfig::Config::from_buffer("a = { b = { c = 1 } } x = 2","key_cache");
+        std::size_t size = cached.key_cache_size();
+        std::cout << cached.get<int>("a.b.c") << ' ' << cached.get<int>("a.b.c") << ' ' << cached.get<int>(luaconfig::Path("a.b.c")) << std::endl;
+        std::cout << cached.key_cache_size() - size << std::endl;
+        cached.set("x",3);
+        cached.set(luaconfig::Path("a.b.c"),4);
+        std::cout << cached.get<int>("x") << ' ' << cached.get<int>("a.b.c") << ' ' << cached.exists("a.b.d") << std::endl;
+        cached.set_key_cache_limit(0);
+        std::cout << cached.get<int>("a.b.c") << ' ' << cached.exists("y") << ' ' << cached.key_cache_size() - size << std::endl;
+    }
+
+    // Writing back to Lua source
+    {
+        auto original = luaconfig::Config::from_buffer(
+            "x = 0.1 n = 42 big = math.mininteger huge = math.huge s = 'tab\\tquote\\\"0\\0001' \n"
+            "t = { 1, 2.5, 'three', { 4 }, name = 'n', ['key with spaces'] = true, [10] = 10, [-1.5] = 'f', [false] = 0 }\n"
+            "f = function() end","dump_original");
+        std::string src;
+        original.dump(src);
+        std::cout << src;
+        auto reloaded = luaconfig::Config::from_buffer(src,"dump_reloaded");
+        // Only the function should be lost
+        for( auto&& key : luaconfig::diff(original.snapshot(),reloaded.snapshot())) std::cout << key << ' ';
+        std::cout << std::endl;
+        std::string again;
+        reloaded.dump(again);
+        std::cout << std::boolalpha << (src == again) << std::endl;
+        original.get<luaconfig::Setting>("t").dump(stdout);
+        auto cyclic = luaconfig::Config::from_buffer("c = {} c.self = c","dump_cyclic");
+        try{
+            std::string out;
+            cyclic.dump(out);
+        } catch( const luaconfig::SerializeException& e){
+            std::cout << e.what() << std::endl;
+        }
+    }
+
+    // Batched lookup
+    {
+        auto many = cfg.get_many<int,double,std::string,bool>("table.int","table.float","table.table.table.string","b");
+        std::cout << std::get<0>(many) << ' ' << std::get<1>(many) << ' ' << std::get<2>(many) << ' ' << std::get<3>(many) << std::endl;
+        std::vector<std::string> keys = {"table.table.string","table.other_table.string","table.string","missing.string","x.y"};
+        for( auto&& str : cfg.get_many<std::string>(keys,std::string("default"))) std::cout << str << ' ';
+        std::cout << std::endl;
+        std::vector<luaconfig::Path> paths = { luaconfig::Path("matrix.1.1"), luaconfig::Path("matrix.2.2"), luaconfig::Path("matrix.3.3")};
+        for( auto&& m : cfg.get_many<double>(paths)) std::cout << m << ' ';
+        std::cout << std::endl;
+        try{
+            cfg.get_many<int,int>("table.int","table.string");
+        } catch( const luaconfig::TypeMismatchException& e){
+            std::cout << e.what() << std::endl;
+        }
+    }
+
     return EXIT_SUCCESS;
 }
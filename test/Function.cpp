@@ -6,6 +6,8 @@
 #include <cstdlib>
 #include <iostream>
 #include <iomanip>
+#include <iterator>
+#include <vector>
 
 int main(void)
 {
@@ -59,5 +61,37 @@ int main(void)
         std::cout << std::get<0>(x) << ", " << std::get<1>(x) << ", " << std::get<2>(x) << std::endl;
     }
 
+    // std::string arguments, errors
+    {
+        std::cout << "Testing std::string arguments h(a,b)=a..b, a=\"string\", b=\"value\"" << std::endl;
+        auto h = cfg.get<luaconfig::Function<std::string(std::string,std::string)>>("h");
+        std::string a("string"), b("value");
+        std::cout << h(a,b) << std::endl;
+        std::cout << "Testing error in function fail(a), a=5" << std::endl;
+        auto fail = cfg.get<luaconfig::Function<double(int)>>("fail");
+        try{
+            fail(5);
+        } catch( const luaconfig::FunctionException& e){
+            std::cout << e.what() << std::endl;
+        }
+        std::cout << "Retesting function after error, a=7" << std::endl;
+        std::cout << cfg.get<luaconfig::Function<double(double)>>("f")(7) << std::endl;
+    }
+
+    // Batched calls
+    {
+        std::cout << "Testing map f(a)=a over 1..5" << std::endl;
+        auto f = cfg.get<luaconfig::Function<double(double)>>("f");
+        std::vector<double> x = {1,2,3,4,5}, y(5);
+        f.map(x.begin(),x.end(),y.begin());
+        for( auto&& v : y) std::cout << v << ' ';
+        std::cout << std::endl;
+        std::cout << "Testing map g(a,b)=a+b over 3000 elements" << std::endl;
+        auto g = cfg.get<luaconfig::Function<double(double,double)>>("g");
+        std::vector<double> a(3000,1.5), b(3000,2.0), c;
+        g.map(a.begin(),a.end(),std::back_inserter(c),b.begin());
+        std::cout << c.size() << ' ' << c.front() << ' ' << c.back() << std::endl;
+    }
+
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,51 @@
+// FunctionPool.cpp
+//
+// Unit test for FunctionPool.hpp
+// Additionally relies on Config.hpp to read config file.
+
+#include <luaconfig/luaconfig.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+int main(void)
+{
+
+    // Open pool of 4 workers
+    luaconfig::FunctionPool<double(double,double)> pool("test.lua","g",4);
+    std::cout << "Workers: " << pool.size() << std::endl;
+
+    // Parallel map
+    {
+        std::cout << "Testing parallel_map g(a,b)=a+b over 100000 elements" << std::endl;
+        std::vector<double> a(100000), b(100000,0.5), c(100000);
+        for( std::size_t i=0; i<a.size(); ++i) a[i] = i;
+        pool.parallel_map(a.begin(),a.end(),c.begin(),b.begin());
+        bool correct = true;
+        for( std::size_t i=0; i<c.size(); ++i) correct = correct && (c[i] == a[i]+b[i]);
+        std::cout << c.front() << ' ' << c.back() << ' ' << (correct ? "correct" : "incorrect") << std::endl;
+    }
+
+    // Asynchronous calls
+    {
+        std::cout << "Testing submit g(a,b)=a+b, a=1..4, b=10" << std::endl;
+        std::vector<std::future<double>> results;
+        for( int i=1; i<=4; ++i) results.push_back(pool.submit(i,10));
+        for( auto&& r : results) std::cout << r.get() << ' ';
+        std::cout << std::endl;
+    }
+
+    // Errors
+    {
+        std::cout << "Testing error in function fail(a), a=5" << std::endl;
+        luaconfig::FunctionPool<double(int)> failing("test.lua","fail",2);
+        auto r = failing.submit(5);
+        try{
+            r.get();
+        } catch( const luaconfig::FunctionException& e){
+            std::cout << e.what() << std::endl;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+// Generator.cpp
+//
+// Unit test for Generator.hpp
+// Additionally relies on Config.hpp to read config file.
+
+#include <luaconfig/luaconfig.hpp>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(void)
+{
+
+    // Open file
+    luaconfig::Config cfg("test.lua");
+
+    // Read sequence
+    {
+        std::cout << "Testing generator sweep(n), n=4" << std::endl;
+        auto sweep = cfg.get<luaconfig::Generator<double>>("sweep");
+        for( auto it = sweep.begin(4); it != sweep.end(); ++it) std::cout << *it << ' ';
+        std::cout << std::endl;
+        std::cout << "Retesting generator for reentry, n=2" << std::endl;
+        for( auto it = sweep.begin(2); it != sweep.end(); ++it) std::cout << *it << ' ';
+        std::cout << std::endl;
+    }
+
+    // Long sequence, abandoned part way
+    {
+        std::cout << "Testing generator sweep(n), n=1000000, summing first 1000" << std::endl;
+        auto sweep = cfg.get<luaconfig::Generator<double>>("sweep");
+        double sum = 0;
+        int count = 0;
+        for( auto it = sweep.begin(1000000); it != sweep.end() && count < 1000; ++it, ++count) sum += *it;
+        std::cout << sum << std::endl;
+    }
+
+    // Tables, kept after the sequence is abandoned
+    {
+        std::cout << "Testing generator points(n), n=10, keeping first 3" << std::endl;
+        std::vector<luaconfig::Setting> kept;
+        {
+            auto points = cfg.get<luaconfig::Generator<luaconfig::Setting>>("points");
+            for( auto it = points.begin(10); it != points.end() && kept.size() < 3; ++it) kept.push_back(*it);
+        }
+        cfg.get<luaconfig::Function<int(std::string)>>("collectgarbage")("collect");
+        for( auto&& p : kept) std::cout << '(' << p.get<int>("x") << ',' << p.get<int>("y") << ") ";
+        std::cout << std::endl;
+    }
+    std::cout << "Live threads: " << cfg.memory_stats().live_threads << std::endl;
+
+    // Errors
+    {
+        std::cout << "Testing error in generator fail_after(n), n=2" << std::endl;
+        auto fail = cfg.get<luaconfig::Generator<int>>("fail_after");
+        try{
+            for( auto it = fail.begin(2); it != fail.end(); ++it) std::cout << *it << ' ';
+        } catch( const luaconfig::FunctionException& e){
+            std::cout << std::endl << e.what() << std::endl;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
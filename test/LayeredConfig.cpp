@@ -0,0 +1,68 @@
+// LayeredConfig.cpp
+//
+// Unit test for LayeredConfig.hpp
+
+#include <luaconfig/luaconfig.hpp>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(void)
+{
+
+    std::vector<std::function<luaconfig::Config()>> sources = {
+        [](){ return luaconfig::Config::from_buffer("pool = { size = 4, timeout = 30 }\nname = 'base'\nlimits = { cpu = 1 }\n","base"); },
+        [](){ return luaconfig::Config::from_buffer("pool = { size = 8 }\nlimits = 'none'\n","site"); },
+        [](){ return luaconfig::Config::from_buffer("pool = { size = 16 }\nhost = 'h1'\n","host"); }
+    };
+    luaconfig::LayeredConfig cfg(sources);
+    std::cout << cfg.size() << std::endl;
+
+    // Tables merged key by key
+    std::cout << cfg.get<int>("pool.size") << ' ' << cfg.get<int>("pool.timeout") << std::endl;
+    std::cout << cfg.get<std::string>("name") << ' ' << cfg.get<std::string>("host") << std::endl;
+    std::cout << cfg.layer_of("pool.size") << ' ' << cfg.layer_of("pool.timeout") << ' ' << cfg.layer_of("host") << std::endl;
+
+    // Replacing a table with another value hides its keys in lower layers
+    std::cout << std::boolalpha << cfg.exists("limits") << ' ' << cfg.exists("limits.cpu") << std::endl;
+    std::cout << cfg.get<int>("limits.cpu",-1) << ' ' << cfg.get<int>("missing",-1) << std::endl;
+    try {
+        cfg.get<int>("missing");
+    } catch( const std::exception& e){
+        std::cout << e.what() << std::endl;
+    }
+
+    // Paths and repeated lookups use the cache
+    luaconfig::Path path("pool.timeout");
+    for( int i=0; i<3; ++i) std::cout << cfg.get<int>(path) << ' ';
+    std::cout << std::endl;
+
+    // Changing a layer requires clearing the cache, so the stale value is read first
+    cfg.layer(2).set(luaconfig::Path("pool.timeout"),60);
+    std::cout << cfg.get<int>("pool.timeout") << ' ';
+    cfg.clear_cache();
+    std::cout << cfg.get<int>("pool.timeout") << std::endl;
+
+    // Sequential loading gives the same result
+    luaconfig::LayeredConfig sequential(sources,false);
+    std::cout << sequential.get<int>("pool.size") << ' ' << sequential.get<int>("pool.timeout") << std::endl;
+
+    // Load errors are rethrown
+    try {
+        luaconfig::LayeredConfig broken({"test.lua","does_not_exist.lua"});
+    } catch( const std::exception& e){
+        std::cout << e.what() << std::endl;
+    }
+
+    // At least one layer is required
+    try {
+        luaconfig::LayeredConfig empty(std::vector<std::string>{});
+    } catch( const std::exception& e){
+        std::cout << e.what() << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+// ReloadingConfig.cpp
+//
+// Unit test for ReloadingConfig.hpp
+// Writes a temporary file reload_test.lua to the working directory.
+
+#include <luaconfig/luaconfig.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Write under a temporary name and rename into place, so a reload never sees a partial file
+void write_source( const char* filename, const std::string& source){
+    std::string tmp = std::string(filename) + ".tmp";
+    {
+        std::ofstream file(tmp);
+        file << source;
+    }
+    std::rename(tmp.c_str(),filename);
+}
+
+void write_file( const char* filename, double x){
+    std::ostringstream source;
+    source << "x = " << x << "\nfunction f(a) return a*x end\n";
+    write_source(filename,source.str());
+}
+
+int main(void)
+{
+
+    const char* filename = "reload_test.lua";
+    write_file(filename,1.0);
+    {
+        // Not watched, so that only explicit reloads occur
+        luaconfig::ReloadingConfig cfg(filename,std::chrono::milliseconds(50),false);
+
+        // Initial version
+        std::cout << cfg.version() << ' ' << cfg.get<double>("x") << std::endl;
+        auto f = cfg.pin<luaconfig::Function<double(double)>>("f");
+        std::cout << (*f)(2) << std::endl;
+
+        // Explicit reload. The pinned Function keeps referring to the first version.
+        write_file(filename,2.0);
+        std::cout << std::boolalpha << cfg.reload() << ' ' << cfg.version() << ' ' << cfg.get<double>("x") << std::endl;
+        std::cout << (*f)(2) << ' ' << (*cfg.pin<luaconfig::Function<double(double)>>("f"))(2) << std::endl;
+
+        // Readers on other threads
+        std::vector<std::thread> readers;
+        std::vector<double> results(4);
+        for( std::size_t i=0; i<results.size(); ++i){
+            readers.emplace_back([&,i](){ results[i] = cfg.get<double>("x"); });
+        }
+        for( auto&& t : readers) t.join();
+        for( auto&& r : results) std::cout << r << ' ';
+        std::cout << std::endl;
+
+        // Broken file keeps the previous version
+        write_source(filename,"x = = 3\n");
+        std::cout << cfg.reload() << ' ' << cfg.version() << ' ' << cfg.get<double>("x") << std::endl;
+        std::cout << cfg.last_error() << std::endl;
+
+        // Change notification
+        std::size_t id = cfg.on_change("x",[]( const luaconfig::ReloadingConfig::Version& v, const std::vector<std::string>& keys){
+            std::cout << "changed in version " << v.number << ':';
+            for( auto&& key : keys) std::cout << ' ' << key;
+            std::cout << std::endl;
+        });
+        cfg.on_change("y.*",[]( const luaconfig::ReloadingConfig::Version&, const std::vector<std::string>&){
+            std::cout << "y should not change" << std::endl;
+        });
+        write_file(filename,3.0);
+        cfg.reload();
+        cfg.remove_on_change(id);
+
+        // Concurrent use of handles pinned from one version
+        auto version = cfg.current();
+        auto g = cfg.pin<luaconfig::Function<double(double)>>(version,"f");
+        std::vector<std::thread> callers;
+        std::vector<double> called(4);
+        for( std::size_t i=0; i<called.size(); ++i){
+            callers.emplace_back([&,i](){
+                auto h = cfg.pin<luaconfig::Function<double(double)>>("f");
+                std::lock_guard<std::mutex> lock(version->mutex);
+                called[i] = (*g)(static_cast<double>(i)) + (*h)(0);
+            });
+        }
+        for( auto&& t : callers) t.join();
+        for( auto&& c : called) std::cout << c << ' ';
+        std::cout << std::endl;
+    }
+    {
+        // Reload by the watcher thread
+        luaconfig::ReloadingConfig cfg(filename,std::chrono::milliseconds(50));
+        write_file(filename,4.0);
+        auto start = std::chrono::steady_clock::now();
+        while( cfg.get<double>("x") != 4.0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5) ){
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        std::cout << cfg.get<double>("x") << ' ' << cfg.last_error().empty() << std::endl;
+    }
+    std::remove(filename);
+
+    return EXIT_SUCCESS;
+}
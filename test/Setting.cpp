@@ -7,8 +7,29 @@
 #include <cstdlib>
 #include <iostream>
 #include <iomanip>
+#include <string>
 #include <vector>
 
+struct Limits {
+    int cpu = 1;
+    int mem = 256;
+};
+LUACONFIG_STRUCT(Limits, cpu, mem)
+
+struct Server {
+    std::string host;
+    int port = 80;
+    std::vector<double> weights;
+    Limits limits;
+};
+LUACONFIG_STRUCT(Server, host, port, weights, limits)
+
+struct Cluster {
+    std::string name;
+    std::vector<Limits> nodes;
+};
+LUACONFIG_STRUCT(Cluster, name, nodes)
+
 int main(void){
 
     // Read test file
@@ -135,6 +156,133 @@ int main(void){
         }
     }
 
+    // Bulk array reads
+    {
+        auto mat = cfg.get<luaconfig::Setting>("matrix");
+        double row[3];
+        mat.get( 2, row, 3);
+        for( auto&& x : row) std::cout << x << ' ';
+        std::cout << std::endl;
+        // Row 3 holds floats, so each read falls back to the default
+        std::vector<int> def{-1};
+        auto v = mat.get<std::vector<int>>(3,def);
+        auto vs = mat.snapshot().get<std::vector<int>>(3,def);
+        auto vb = mat.get_many<std::vector<int>>(std::vector<std::string>{"3","1"},def);
+        std::cout << "Default on mismatch: " << std::boolalpha << (v == def) << ' ' << (vs == def) << ' '
+                  << (vb[0] == def) << ' ' << (vb[1] == def) << std::endl;
+    }
+
+    // Thread recycling
+    // Settings released back to the thread pool should be reused cleanly.
+    {
+        std::vector<luaconfig::Setting> settings;
+        for( int i=0; i<100; ++i) settings.push_back(cfg.get<luaconfig::Setting>("color"));
+        settings.erase( settings.begin(), settings.begin()+50);
+        for( int i=0; i<100; ++i) settings.push_back(cfg.get<luaconfig::Setting>("table"));
+        auto r = settings.front().get<double>("r");
+        auto s = settings.back().get<std::string>("string");
+        std::cout << "After recycling: " << r << ' ' << s << std::endl;
+    }
+
+    // Precompiled paths
+    {
+        auto tab = cfg.get<luaconfig::Setting>("table");
+        auto sub = tab.get<luaconfig::Setting>("table");
+        luaconfig::Path p("table.string");
+        std::cout << tab.get<std::string>(p) << std::endl;
+        tab.refocus(sub,luaconfig::Path("other_table"));
+        std::cout << sub.get<std::string>(luaconfig::Path("string")) << std::endl;
+        tab.set(luaconfig::Path("table.table.int"),7);
+        std::cout << tab.get<int>(luaconfig::Path("table.table.int")) << std::endl;
+    }
+
+
+    // Iteration
+    {
+        auto color = cfg.get<luaconfig::Setting>("color");
+        double sum = 0;
+        for( auto&& entry : color) sum += entry.as<double>();
+        std::cout << "color sum " << sum << std::endl;
+        auto table = cfg.get<luaconfig::Setting>("table");
+        int n_tables = 0, n_other = 0;
+        for( auto&& entry : table.pairs()){
+            if( entry.is<luaconfig::Setting>() ) ++n_tables;
+            else ++n_other;
+        }
+        std::cout << n_tables << " tables, " << n_other << " other" << std::endl;
+        auto array = cfg.get<luaconfig::Setting>("array");
+        for( auto&& entry : array.ipairs()) std::cout << entry.index() << ':' << entry.as<double>() << ' ';
+        std::cout << std::endl;
+        try{
+            for( auto&& entry : table.pairs()) entry.as<double>();
+        } catch( const luaconfig::TypeMismatchException& e){
+            std::cout << e.what() << std::endl;
+        }
+        // Array with an element of the wrong type gives the default
+        auto broken = cfg.get<luaconfig::Setting>("servers.broken");
+        for( auto&& entry : broken.pairs()){
+            if( entry.key() && std::string(entry.key()) == "weights" ){
+                std::cout << "weights default " << entry.as<std::vector<double>>(std::vector<double>{-1}).at(0) << std::endl;
+            }
+        }
+    }
+
+    // Struct binding
+    {
+        auto servers = cfg.get<luaconfig::Setting>("servers");
+        auto primary = servers.get<Server>("primary");
+        std::cout << primary.host << ':' << primary.port << ' ' << primary.weights.size() << ' '
+                  << primary.limits.cpu << ' ' << primary.limits.mem << std::endl;
+        auto backup = servers.get<Server>("backup");
+        std::cout << backup.host << ':' << backup.port << ' ' << backup.weights.size() << ' '
+                  << backup.limits.cpu << ' ' << backup.limits.mem << std::endl;
+        try{
+            servers.get<Server>("broken");
+        } catch( const luaconfig::BindingException& e){
+            std::cout << e.what() << std::endl;
+        }
+        // Errors within vectors name the element
+        auto clusters = luaconfig::Config::from_buffer("c = { name = 'c1', nodes = { { cpu = 2 }, { cpu = 'many', mem = false } } }","clusters");
+        try{
+            clusters.get<Cluster>("c");
+        } catch( const luaconfig::BindingException& e){
+            std::cout << e.what() << std::endl;
+        }
+        // Mismatched structs give the default
+        Server fallback;
+        fallback.host = "fallback";
+        std::cout << servers.get<Server>("broken",fallback).host << std::endl;
+        std::cout << clusters.get<Cluster>("c",Cluster()).nodes.size() << std::endl;
+        auto list = luaconfig::Config::from_buffer("l = { { host = 'a' }, { host = 1 } }","servers");
+        std::cout << list.get<std::vector<Server>>("l",std::vector<Server>()).size() << std::endl;
+        std::cout << servers.get_many<Server>(std::vector<std::string>{"broken"},fallback)[0].host << std::endl;
+    }
+
+    // N-dimensional arrays by integer index
+    {
+        std::vector<std::size_t> shape;
+        std::vector<int> data;
+        cfg.get<luaconfig::Setting>("cube").get_ndarray(2,shape,data);
+        std::cout << shape[0] << 'x' << shape[1] << ':';
+        for( auto&& x : data) std::cout << ' ' << x;
+        std::cout << std::endl;
+        auto odd = luaconfig::Config::from_buffer("t = { { {1,2}, 3 } }","ndarray");
+        try{
+            odd.get<luaconfig::Setting>("t").get_ndarray(1,shape,data);
+        } catch( const luaconfig::ShapeMismatchException& e){
+            std::cout << e.what() << std::endl;
+        }
+    }
+
+    // Batched lookup, with integer indices at table scope
+    {
+        auto matrix = cfg.get<luaconfig::Setting>("matrix");
+        auto diagonal = matrix.get_many<double,double,double>("1.1","2.2","3.3");
+        std::cout << std::get<0>(diagonal) << ' ' << std::get<1>(diagonal) << ' ' << std::get<2>(diagonal) << std::endl;
+        auto table = cfg.get<luaconfig::Setting>("table");
+        auto nested = table.get_many<luaconfig::Setting,int>("table","int");
+        std::cout << std::get<0>(nested).get<std::string>("string") << ' ' << std::get<1>(nested) << std::endl;
+    }
 
     return EXIT_SUCCESS;
 }
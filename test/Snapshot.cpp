@@ -0,0 +1,147 @@
+// Snapshot.cpp
+//
+// Unit test for Snapshot.hpp
+// Additionally relies on Config.hpp to read config file.
+
+#include <luaconfig/luaconfig.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+
+int main(void)
+{
+
+    // Open file
+    luaconfig::Config cfg("test.lua");
+    luaconfig::Snapshot snap = cfg.snapshot();
+
+    // Simple reading
+    {
+        auto x = snap.get<double>("x");
+        auto i = snap.get<int>("i");
+        auto b = snap.get<bool>("b");
+        auto s = snap.get<std::string>("s");
+        std::cout << x << ' ' << i << ' ' << std::boolalpha << b << ' ' << s << std::endl;
+        // Numbers converted to strings as by Lua
+        std::cout << snap.get<std::string>("i") << ' ' << snap.get<std::string>("table.float") << std::endl;
+    }
+
+    // Dot notation, integer indexing and precompiled paths
+    {
+        std::cout << snap.get<std::string>("table.table.table.string") << std::endl;
+        std::cout << snap.get<double>("matrix.2.3") << std::endl;
+        std::cout << snap.get<double>(luaconfig::Path("array.4")) << std::endl;
+    }
+
+    // Defaults and exceptions
+    {
+        std::cout << snap.get<int>("not_a_variable",17) << std::endl;
+        std::cout << snap.get<int>("array.1",17) << std::endl;
+        try{
+            snap.get<int>("s");
+        } catch( const luaconfig::TypeMismatchException& e){
+            std::cout << e.what() << std::endl;
+        }
+    }
+
+    // exists and len
+    {
+        std::cout << std::boolalpha << snap.exists("array.1") << ' ' << snap.exists("qwerty") << std::endl;
+        std::cout << snap.len("array") << ' ' << snap.len("matrix") << std::endl;
+        std::cout << std::boolalpha << snap.exists("f") << std::endl;
+    }
+
+    // Sub-snapshots and arrays
+    {
+        auto mat = snap.get<luaconfig::Snapshot>("matrix");
+        for( std::size_t i=1; i<=mat.len(); ++i){
+            auto row = mat.get<std::vector<double>>(i);
+            for( auto&& x : row) std::cout << x << ' ';
+            std::cout << std::endl;
+        }
+        auto tab = cfg.get<luaconfig::Setting>("table").snapshot();
+        std::cout << tab.get<std::string>("other_table.string") << std::endl;
+    }
+
+    // Snapshot is unaffected by later changes
+    {
+        cfg.set("x",1);
+        std::cout << cfg.get<int>("x") << ' ' << snap.get<int>("x") << std::endl;
+    }
+
+    // Concurrent reads
+    {
+        std::vector<std::thread> threads;
+        std::vector<double> sums(4,0.0);
+        for( int t=0; t<4; ++t){
+            threads.emplace_back([&snap,&sums,t](){
+                for( int n=0; n<1000; ++n) sums[t] += snap.get<double>("matrix.3.3");
+            });
+        }
+        for( auto&& th : threads) th.join();
+        for( auto&& s : sums) std::cout << s << ' ';
+        std::cout << std::endl;
+    }
+
+    // Diff
+    {
+        auto before = luaconfig::Config::from_buffer("pools = { db = { size = 4 }, cache = { size = 2 } } timeout = 5 f = function() return 1 end","before");
+        auto after = luaconfig::Config::from_buffer("pools = { db = { size = 8 }, web = { size = 1 } } timeout = 5 f = function() return 2 end","after");
+        auto a = before.snapshot();
+        auto b = after.snapshot();
+        for( auto&& key : luaconfig::diff(a,b)) std::cout << key << ' ';
+        std::cout << std::endl;
+        std::cout << luaconfig::diff(a,a).size() << ' ' << (a.hash() == before.snapshot().hash()) << ' ' << (a.hash() == b.hash()) << std::endl;
+        std::cout << luaconfig::key_matches("pools.*.size","pools.db.size") << ' '
+                  << luaconfig::key_matches("pools.*.size","pools") << ' '
+                  << luaconfig::key_matches("pools.*.size","pools.db.name") << ' '
+                  << luaconfig::key_matches("pools.**","pools.db.name") << std::endl;
+    }
+
+    // Binary images
+    {
+        snap.save("snapshot_test.img");
+        auto mapped = luaconfig::Snapshot::map("snapshot_test.img",true);
+        std::cout << mapped.get<double>("x") << ' ' << mapped.get<std::string>("s") << ' '
+                  << mapped.get<double>("table.float") << ' ' << mapped.len("array") << ' '
+                  << (mapped.hash() == snap.hash()) << std::endl;
+        auto sub = mapped.get<luaconfig::Snapshot>("table");
+        std::cout << sub.get<std::string>("string") << std::endl;
+        {
+            std::FILE* f = std::fopen("snapshot_test.img","r+b");
+            std::fputs("garbage",f);
+            std::fclose(f);
+        }
+        try{
+            luaconfig::Snapshot::map("snapshot_test.img");
+        } catch( const luaconfig::FileException& e){
+            std::cout << e.what() << std::endl;
+        }
+        std::remove("snapshot_test.img");
+    }
+
+    // Numeric first tokens at global scope are text, as in Config
+    {
+        auto numeric = luaconfig::Config::from_buffer("_G['1'] = 'one' t = { 'first' }","numeric");
+        auto numeric_snap = numeric.snapshot();
+        std::cout << numeric.get<std::string>("1") << ' ' << numeric_snap.get<std::string>("1") << ' '
+                  << numeric_snap.get<std::string>(luaconfig::Path("1")) << ' ' << numeric_snap.get<std::string>("t.1") << std::endl;
+        numeric_snap.save("snapshot_numeric.img");
+        std::cout << luaconfig::Snapshot::map("snapshot_numeric.img").get<std::string>("1") << std::endl;
+        std::remove("snapshot_numeric.img");
+    }
+
+    // Global scope skips _G, _VERSION and libraries, but keeps other references to them
+    {
+        auto libs = luaconfig::Config::from_buffer("strings = string x = 1","libs");
+        auto libs_snap = libs.snapshot();
+        std::cout << std::boolalpha << libs_snap.exists("_G") << ' ' << libs_snap.exists("_VERSION") << ' '
+                  << libs_snap.exists("string") << ' ' << libs_snap.exists("strings.format") << ' '
+                  << libs_snap.get<int>("x") << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
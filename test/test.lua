@@ -10,6 +10,7 @@ i = 44
 
 color = { r=0.5, g=0.7, b=0 }
 array = { 0.1, 0.2, 0.3, 0.4 }
+strings = { "a", "b", "c" }
 
 table = {
     float = 0.2,
@@ -33,6 +34,22 @@ matrix = {
     { 7.0 , 8.0 , 9.0 },
 }
 
+cube = {
+    { {1,2}, {3,4} },
+    { {5,6}, {7,8} },
+}
+
+ragged = {
+    { 1.0, 2.0 },
+    { 3.0 },
+}
+
+servers = {
+    primary = { host = "alpha", port = 8080, weights = { 0.5, 0.25 }, limits = { cpu = 4, mem = 1024 } },
+    backup = { host = "beta", weights = {} },
+    broken = { host = 12, port = "eighty", weights = { 1, "two" }, limits = { cpu = true } },
+}
+
 function f(a)
     return a
 end
@@ -48,3 +65,26 @@ end
 function m(a)
     return a,a+1,a+2
 end
+
+function fail(a)
+    error("failed with "..a)
+end
+
+function sweep(n)
+    for i=1,n do
+        coroutine.yield(i/n)
+    end
+end
+
+function points(n)
+    for i=1,n do
+        coroutine.yield({x=i, y=i*i})
+    end
+end
+
+function fail_after(n)
+    for i=1,n do
+        coroutine.yield(i)
+    end
+    error("stopped after "..n)
+end
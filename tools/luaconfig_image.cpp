@@ -0,0 +1,57 @@
+// luaconfig_image.cpp
+//
+// Compile a Lua configuration file into a binary snapshot image, which programs may then load
+// with luaconfig::Snapshot::map, and query existing images.
+//
+//     luaconfig_image settings.lua settings.img      compile
+//     luaconfig_image -q settings.img a.b.1.c ...    print values of keys
+//     luaconfig_image -v settings.img                verify image, print its size
+
+#include <luaconfig/luaconfig.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+static int usage( const char* name){
+    std::cerr << "Usage: " << name << " <config.lua> <image>\n"
+              << "       " << name << " -q <image> <key>...\n"
+              << "       " << name << " -v <image>\n";
+    return EXIT_FAILURE;
+}
+
+// Value as text, trying each type a Snapshot can return
+static std::string describe( const luaconfig::Snapshot& snap, const char* key){
+    if( !snap.exists(key) ) return "nil";
+    try{ return snap.get<std::string>(key); } catch( const luaconfig::TypeMismatchException&) {}
+    try{ return snap.get<bool>(key) ? "true" : "false"; } catch( const luaconfig::TypeMismatchException&) {}
+    try{
+        snap.get<luaconfig::Snapshot>(key);
+        return "table, length " + std::to_string(snap.len(key));
+    } catch( const luaconfig::TypeMismatchException&) {}
+    return "function";
+}
+
+int main( int argc, char** argv)
+{
+    if( argc < 3 ) return usage(argv[0]);
+    try{
+        if( std::strcmp(argv[1],"-q") == 0 ){
+            auto snap = luaconfig::Snapshot::map(argv[2]);
+            for( int i=3; i<argc; ++i) std::cout << argv[i] << " = " << describe(snap,argv[i]) << '\n';
+        } else if( std::strcmp(argv[1],"-v") == 0 ){
+            auto snap = luaconfig::Snapshot::map(argv[2],true);
+            const luaconfig::SnapshotView& view = snap.view();
+            std::cout << argv[2] << ": " << view.n_nodes << " nodes, " << view.n_entries << " entries, "
+                      << view.n_strings << " bytes of strings\n";
+        } else {
+            if( argc != 3 ) return usage(argv[0]);
+            luaconfig::Config cfg(argv[1]);
+            cfg.snapshot().save(argv[2]);
+        }
+    } catch( const std::exception& e){
+        std::cerr << argv[0] << ": " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}